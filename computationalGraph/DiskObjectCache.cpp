@@ -0,0 +1,198 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "DiskObjectCache.hpp"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+static const char *magic = "llvm_jit_compile object 1";
+static const char *extension = ".jitobj";
+
+DiskObjectCache::DiskObjectCache(const std::string &directory, uint64_t maxBytes)
+    : directory(directory), maxBytes(maxBytes) {
+    llvm::sys::fs::create_directories(directory);
+
+    // Everything about the host which changes the generated code.
+    llvm::StringMap<bool> features;
+    std::vector<std::string> attributes;
+    if (llvm::sys::getHostCPUFeatures(features)) {
+        for (auto &feature : features) {
+            attributes.push_back((feature.getValue() ? "+" : "-") + feature.getKey().str());
+        }
+    }
+    std::sort(attributes.begin(), attributes.end());
+    target = llvm::sys::getProcessTriple() + "|" + llvm::sys::getHostCPUName().str() + "|";
+    for (auto &attribute : attributes) {
+        target += attribute + ",";
+    }
+}
+
+uint64_t DiskObjectCache::fnv1a(llvm::StringRef data, uint64_t hash) {
+    for (char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string DiskObjectCache::content_identifier(const llvm::Module &module) {
+    std::string text;
+    llvm::raw_string_ostream stream(text);
+    module.print(stream, nullptr);
+    stream.flush();
+    return "ir-" + llvm::utohexstr(fnv1a(text));
+}
+
+std::string DiskObjectCache::key(const llvm::Module *module) const {
+    return module->getModuleIdentifier() + "|" + target;
+}
+
+std::string DiskObjectCache::path(const std::string &key) const {
+    llvm::SmallString<256> result(directory);
+    llvm::sys::path::append(result, llvm::utohexstr(fnv1a(key)) + extension);
+    return std::string(result.str());
+}
+
+void DiskObjectCache::notifyObjectCompiled(const llvm::Module *module, llvm::MemoryBufferRef object) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string objectKey = key(module);
+    std::string objectPath = path(objectKey);
+
+    // Write to a temporary file and rename it, so that a reader never sees
+    // a partially written object.
+    int fd;
+    llvm::SmallString<256> temporaryPath;
+    if (llvm::sys::fs::createUniqueFile(objectPath + ".%%%%%%.tmp", fd, temporaryPath)) {
+        return;
+    }
+    {
+        llvm::raw_fd_ostream stream(fd, true);
+        stream << magic << "\n"
+            << objectKey << "\n"
+            << object.getBufferSize() << "\n"
+            << llvm::utohexstr(fnv1a(object.getBuffer())) << "\n";
+        stream << object.getBuffer();
+    }
+    if (llvm::sys::fs::rename(temporaryPath, objectPath)) {
+        llvm::sys::fs::remove(temporaryPath);
+        return;
+    }
+    evict();
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::getObject(const llvm::Module *module) {
+    return lookup(module, nullptr);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::lookup(const llvm::Module *module, std::string *discarded) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<llvm::MemoryBuffer> object = load(key(module), discarded);
+    if (object == nullptr) {
+        return nullptr;
+    }
+
+    // Mark the file as recently used for eviction.
+    int fd;
+    if (!llvm::sys::fs::openFileForRead(path(key(module)), fd)) {
+        llvm::sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+        llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+    }
+    return object;
+}
+
+// Read the object stored for objectKey, deleting the file if it is invalid.
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::load(const std::string &objectKey, std::string *discarded) {
+    std::string objectPath = path(objectKey);
+
+    auto file = llvm::MemoryBuffer::getFile(objectPath);
+    if (!file) {
+        return nullptr;
+    }
+
+    // Validate the header before trusting the object.
+    llvm::StringRef rest = (*file)->getBuffer();
+    std::string fields[4];
+    for (int i = 0; i < 4; i++) {
+        auto split = rest.split('\n');
+        fields[i] = split.first.str();
+        rest = split.second;
+    }
+    uint64_t size = 0;
+    if (fields[0] != magic || fields[1] != objectKey
+        || llvm::StringRef(fields[2]).getAsInteger(10, size) || size != rest.size()
+        || fields[3] != llvm::utohexstr(fnv1a(rest))) {
+        if (discarded != nullptr) {
+            *discarded = "discarded the invalid object " + objectPath;
+        }
+        llvm::sys::fs::remove(objectPath);
+        return nullptr;
+    }
+    return llvm::MemoryBuffer::getMemBufferCopy(rest, objectPath);
+}
+
+// Remove the least recently used objects until the directory fits maxBytes.
+void DiskObjectCache::evict() {
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        llvm::sys::TimePoint<> time;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+
+    std::error_code error;
+    for (llvm::sys::fs::directory_iterator it(directory, error), end; it != end && !error; it.increment(error)) {
+        if (!llvm::StringRef(it->path()).endswith(extension)) {
+            continue;
+        }
+        llvm::sys::fs::file_status status;
+        if (llvm::sys::fs::status(it->path(), status)) {
+            continue;
+        }
+        entries.push_back({it->path(), status.getSize(), status.getLastModificationTime()});
+        total += status.getSize();
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.time < b.time;
+    });
+    for (auto &entry : entries) {
+        if (total <= maxBytes) {
+            break;
+        }
+        llvm::sys::fs::remove(entry.path);
+        total -= entry.size;
+    }
+}
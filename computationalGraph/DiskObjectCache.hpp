@@ -0,0 +1,73 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef DISKOBJECTCACHE_HPP_
+#define DISKOBJECTCACHE_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+/// DiskObjectCache - ObjectCache which keeps compiled objects in a directory,
+/// so that a restarted process only has to link them.
+///
+/// Objects are looked up by module identifier, so whoever creates the module
+/// has to make the identifier describe its content, for example with
+/// content_identifier(). The host triple, CPU and CPU features are added to
+/// the key, since an object built for one CPU can't be used on another.
+/// Every file starts with a header holding the full key, the object size and
+/// a checksum, and files which don't match are deleted instead of loaded.
+/// When the directory grows beyond maxBytes the least recently used files
+/// are removed.
+class DiskObjectCache : public llvm::ObjectCache {
+    std::mutex mutex;
+    std::string directory;
+    uint64_t maxBytes;
+    std::string target;
+
+    std::string key(const llvm::Module *module) const;
+    std::string path(const std::string &key) const;
+    std::unique_ptr<llvm::MemoryBuffer> load(const std::string &key, std::string *discarded);
+    void evict();
+
+ public:
+    DiskObjectCache(const std::string &directory, uint64_t maxBytes);
+
+    static uint64_t fnv1a(llvm::StringRef data, uint64_t hash = 14695981039346656037ULL);
+    // A hash of the printed IR of module.
+    static std::string content_identifier(const llvm::Module &module);
+
+    // The object stored for module, or nullptr. When an invalid file was
+    // deleted instead, discarded, if given, describes it.
+    std::unique_ptr<llvm::MemoryBuffer> lookup(const llvm::Module *module, std::string *discarded);
+
+    void notifyObjectCompiled(const llvm::Module *module, llvm::MemoryBufferRef object) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *module) override;
+};
+
+#endif  // DISKOBJECTCACHE_HPP_
@@ -24,26 +24,18 @@
 
 #include "ExprAST.hpp"
 
-llvm::Value* Expr::accept(IRVisitor* builder) {
-    return value->accept(builder);
-}
-
 Expr::Expr(double v) {
-    std::shared_ptr<ExprAST> p(new NumberExprAST(v));
-    value = p;
+    value = make_expr<NumberExprAST>(v).value;
 }
 
 Expr operator+ (Expr lhs, Expr rhs) {
-    std::shared_ptr<ExprAST> p(new BinaryExprAST('+', lhs, rhs));
-    return Expr(p);
+    return make_expr<BinaryExprAST>('+', std::move(lhs), std::move(rhs));
 }
 
 Expr operator* (Expr lhs, Expr rhs) {
-    std::shared_ptr<ExprAST> p(new BinaryExprAST('*', lhs, rhs));
-    return Expr(p);
+    return make_expr<BinaryExprAST>('*', std::move(lhs), std::move(rhs));
 }
 
 Expr operator/ (Expr lhs, Expr rhs) {
-    std::shared_ptr<ExprAST> p(new BinaryExprAST('/', lhs, rhs));
-    return Expr(p);
+    return make_expr<BinaryExprAST>('/', std::move(lhs), std::move(rhs));
 }
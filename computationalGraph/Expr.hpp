@@ -25,8 +25,6 @@
 
 #include <memory>
 
-#include "IRVisitor.hpp"
-
 class ExprAST;
 
 struct Expr {
@@ -35,7 +33,6 @@ struct Expr {
     Expr() = default;
     Expr(double);
     explicit Expr(std::shared_ptr<ExprAST> ast) : value(ast) {}
-    llvm::Value* accept(IRVisitor* builder);
 };
 
 Expr operator+ (Expr lhs, Expr rhs);
@@ -20,28 +20,79 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
+#include <unordered_map>
 #include <utility>
 
 #include "ExprAST.hpp"
-#include "IRVisitor.hpp"
+#include "Graph.hpp"
 
-void VarExprAST::dump(int level) {
-    for (int i = 0; i < level; i++) { std::cout << "-"; }
-    std::cout << "VarExprAST" << std::endl;
+// Deeper levels of dump are indented this far, and numbered.
+static const int dumpIndent = 32;
+
+// Walks the tree with an explicit stack. A node seen before is printed as a
+// reference to its number instead of again, so that the output of a graph
+// with shared subtrees is linear in the number of nodes.
+void ExprAST::dump(int level) {
+    std::unordered_map<ExprAST*, int> node2Number;
+    std::vector<std::pair<ExprAST*, int>> stack = {std::make_pair(this, level)};
+    while (!stack.empty()) {
+        ExprAST *node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        std::cout << std::string(std::min(depth, dumpIndent), '-');
+        if (depth > dumpIndent) {
+            std::cout << "[" << depth << "]";
+        }
+        auto found = node2Number.find(node);
+        if (found != node2Number.end()) {
+            std::cout << "#" << found->second << std::endl;
+            continue;
+        }
+        int number = static_cast<int>(node2Number.size());
+        node2Number[node] = number;
+        std::cout << node->label() << " #" << number << std::endl;
+        std::vector<Expr> operands = node->operands();
+        for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+            stack.push_back(std::make_pair(it->value.get(), depth + 1));
+        }
+    }
+}
+
+void ExprAST::release(std::vector<Expr> operands) {
+    while (!operands.empty()) {
+        Expr operand = std::move(operands.back());
+        operands.pop_back();
+        // Nodes in a GraphArena have no use count, or share the one of the
+        // arena, and are destroyed by it.
+        if (operand.value != nullptr && operand.value.use_count() == 1) {
+            operand.value->take_operands(&operands);
+        }
+    }
+}
+
+std::string VarExprAST::label() const {
+    return "VarExprAST";
 }
 
-llvm::Value* VarExprAST::accept(IRVisitor* visitor) {
-    auto p = visitor->name2Value[name];
-    return p;
+int VarExprAST::lower(Lowering* lowering) {
+    return lowering->variable(name);
 }
 
-void NumberExprAST::dump(int level) {
-    for (int i = 0; i < level; i++) { std::cout << "-"; }
-    std::cout << "NumberExprAST" << std::endl;
+std::string ParamExprAST::label() const {
+    return "ParamExprAST";
 }
 
-llvm::Value* NumberExprAST::accept(IRVisitor* visitor) {
-    return visitor->createValue(value);
+int ParamExprAST::lower(Lowering* lowering) {
+    return lowering->graph()->parameter(name, value);
+}
+
+std::string NumberExprAST::label() const {
+    return "NumberExprAST";
+}
+
+int NumberExprAST::lower(Lowering* lowering) {
+    return lowering->graph()->constant(value);
 }
 
 BinaryExprAST::BinaryExprAST(char operation, Expr a, Expr b) {
@@ -50,46 +101,55 @@ BinaryExprAST::BinaryExprAST(char operation, Expr a, Expr b) {
     op = operation;
 }
 
-llvm::Value* BinaryExprAST::accept(IRVisitor* visitor) {
-    std::cout << "accept - BinaryExprAST" << std::endl;
-    llvm::Value* left = visitor->visit(lhs);
-    llvm::Value* right = visitor->visit(rhs);
+BinaryExprAST::~BinaryExprAST() {
+    std::vector<Expr> operands;
+    take_operands(&operands);
+    release(std::move(operands));
+}
+
+void BinaryExprAST::take_operands(std::vector<Expr>* operands) {
+    operands->push_back(std::move(lhs));
+    operands->push_back(std::move(rhs));
+}
+
+int BinaryExprAST::lower(Lowering* lowering) {
+    int left = lowering->index(lhs);
+    int right = lowering->index(rhs);
     switch (op) {
     case '+':
-        return visitor->builder->CreateFAdd(left, right, "addtmp");
+        return lowering->graph()->operation(Graph::Add, left, right);
     case '*':
-        return visitor->builder->CreateFMul(left, right, "multmp");
+        return lowering->graph()->operation(Graph::Multiply, left, right);
     case '/':
-        return visitor->builder->CreateFDiv(left, right, "divtmp");
+        return lowering->graph()->operation(Graph::Divide, left, right);
     }
-    return nullptr;
+    throw 1;
 }
 
-void BinaryExprAST::dump(int level) {
-    for (int i = 0; i < level; i++) { std::cout << "-"; }
-    std::cout << "BinaryExprAST" << std::endl;
-    lhs.value->dump(level + 1);
-    rhs.value->dump(level + 1);
+std::string BinaryExprAST::label() const {
+    return "BinaryExprAST";
 }
 
 Sin::Sin(Expr a) {
     arg = std::move(a);
 }
 
-llvm::Value* Sin::accept(IRVisitor* visitor) {
-    llvm::Value* argValue = visitor->visit(arg);
-    llvm::Function *func = visitor->module->getFunction("sin");
-    if (func == NULL) {
-        llvm::FunctionCallee callee = visitor->module->getOrInsertFunction(
-            "sin",
-            llvm::Type::getDoubleTy(*(visitor->context())),
-            llvm::Type::getDoubleTy(*(visitor->context())));
-        func = visitor->module->getFunction("sin");
-    }
-    return visitor->builder->CreateCall(func, argValue, "tmphoge");
+Sin::~Sin() {
+    std::vector<Expr> operands;
+    take_operands(&operands);
+    release(std::move(operands));
+}
+
+void Sin::take_operands(std::vector<Expr>* operands) {
+    operands->push_back(std::move(arg));
+}
+
+int Sin::lower(Lowering* lowering) {
+    return lowering->graph()->operation(Graph::Sine, lowering->index(arg));
 }
 
-void Sin::dump(int level) {
+std::string Sin::label() const {
+    return "Sin";
 }
 
 Pow::Pow(Expr _a, Expr _b) {
@@ -97,22 +157,23 @@ Pow::Pow(Expr _a, Expr _b) {
     b = std::move(_b);
 }
 
-llvm::Value* Pow::accept(IRVisitor* visitor) {
-    llvm::Value* a_v = visitor->visit(a);
-    llvm::Value* b_v = visitor->visit(b);
-    llvm::Function *func = visitor->module->getFunction("pow");
-    if (func == NULL) {
-        llvm::FunctionCallee callee = visitor->module->getOrInsertFunction(
-            "pow",
-            llvm::Type::getDoubleTy(*(visitor->context())),
-            llvm::Type::getDoubleTy(*(visitor->context())),
-            llvm::Type::getDoubleTy(*(visitor->context())));
-        func = visitor->module->getFunction("pow");
-    }
-    std::vector<llvm::Value *> arguments_values = {a_v, b_v};
-    llvm::ArrayRef<llvm::Value*> array(arguments_values);
-    return visitor->builder->CreateCall(func, array, "tmphoge");
+Pow::~Pow() {
+    std::vector<Expr> operands;
+    take_operands(&operands);
+    release(std::move(operands));
+}
+
+void Pow::take_operands(std::vector<Expr>* operands) {
+    operands->push_back(std::move(a));
+    operands->push_back(std::move(b));
+}
+
+int Pow::lower(Lowering* lowering) {
+    int a_n = lowering->index(a);
+    int b_n = lowering->index(b);
+    return lowering->graph()->operation(Graph::Power, a_n, b_n);
 }
 
-void Pow::dump(int level) {
+std::string Pow::label() const {
+    return "Pow";
 }
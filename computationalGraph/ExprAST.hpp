@@ -23,9 +23,12 @@
 #ifndef EXPRAST_HPP_
 #define EXPRAST_HPP_
 
+#include <cstdint>
 #include <memory>
+#include <new>
 #include <map>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <iostream>
 #include <utility>
@@ -38,16 +41,30 @@
 #include "llvm/IR/IRBuilder.h"
 
 #include "Expr.hpp"
+#include "GraphArena.hpp"
 
-class IRVisitor;
+class Lowering;
 
 /// ExprAST - Base class for all expression nodes.
 class ExprAST {
+ protected:
+    // Destroy operands, and the operands of those only they refer to, one
+    // at a time, so that a deep chain doesn't overflow the stack.
+    static void release(std::vector<Expr> operands);
+
  public:
     ExprAST() = default;
     virtual ~ExprAST() = default;
-    virtual void dump(int level = 0) = 0;
-    virtual llvm::Value* accept(IRVisitor* builder) = 0;
+    // Print the tree below this node, each shared node only once.
+    void dump(int level = 0);
+    // The name of this node in dump.
+    virtual std::string label() const = 0;
+    // Append this node to the graph of lowering, whose operands are already
+    // in it, returning its index.
+    virtual int lower(Lowering* lowering) = 0;
+    virtual std::vector<Expr> operands() const { return {}; }
+    // Move the operands out into operands, leaving this node without any.
+    virtual void take_operands(std::vector<Expr>* /*operands*/) {}
 };
 
 /// VarExprAST - Expression class for referencing a Var, like "a".
@@ -56,9 +73,22 @@ class VarExprAST : public ExprAST {
 
  public:
     VarExprAST(std::string name) : name(name) {}
-    // ~VarExprAST() { std::cout << "VarExprAST is deleted." << std::endl; }
-    void dump(int level = 0) override;
-    llvm::Value* accept(IRVisitor* visitor) override;
+    const std::string& get_name() const { return name; }
+    std::string label() const override;
+    int lower(Lowering* lowering) override;
+};
+
+/// ParamExprAST - Expression class for referencing a Param, like "rate".
+class ParamExprAST : public ExprAST {
+    std::string name;
+    double value;
+
+ public:
+    ParamExprAST(std::string name, double value) : name(name), value(value) {}
+    const std::string& get_name() const { return name; }
+    double get_value() const { return value; }
+    std::string label() const override;
+    int lower(Lowering* lowering) override;
 };
 
 /// NumberExprAST - Expression class for referencing an invariables, like "2.0".
@@ -67,8 +97,9 @@ class NumberExprAST : public ExprAST {
 
  public:
     NumberExprAST(double value) : value(value) {}
-    void dump(int level = 0) override;
-    llvm::Value* accept(IRVisitor* visitor) override;
+    double get_value() const { return value; }
+    std::string label() const override;
+    int lower(Lowering* lowering) override;
 };
 
 /// BinaryExprAST - Expression class for a binary operator.
@@ -79,17 +110,22 @@ class BinaryExprAST : public ExprAST {
 
  public:
     BinaryExprAST(char operation, Expr a, Expr b);
-    // ~BinaryExprAST() { std::cout << "BinaryExprAST is deleted." << std::endl; }
-    void dump(int level = 0) override;
-    llvm::Value* accept(IRVisitor* builder) override;
+    ~BinaryExprAST();
+    std::vector<Expr> operands() const override { return {lhs, rhs}; }
+    void take_operands(std::vector<Expr>* operands) override;
+    std::string label() const override;
+    int lower(Lowering* lowering) override;
 };
 
 class Sin: public ExprAST {
     Expr arg;
  public:
     explicit Sin(Expr a);
-    void dump(int level = 0) override;
-    llvm::Value* accept(IRVisitor* builder) override;
+    ~Sin();
+    std::vector<Expr> operands() const override { return {arg}; }
+    void take_operands(std::vector<Expr>* operands) override;
+    std::string label() const override;
+    int lower(Lowering* lowering) override;
 };
 
 class Pow: public ExprAST {
@@ -97,20 +133,77 @@ class Pow: public ExprAST {
     Expr b;
  public:
     explicit Pow(Expr a, Expr b);
-    void dump(int level = 0) override;
-    llvm::Value* accept(IRVisitor* builder) override;
+    ~Pow();
+    std::vector<Expr> operands() const override { return {a, b}; }
+    void take_operands(std::vector<Expr>* operands) override;
+    std::string label() const override;
+    int lower(Lowering* lowering) override;
 };
 
+// Constructs a node in arena, or on the heap if arena is nullptr. Nodes in
+// an arena are referenced without ownership, see GraphBuilder.
+template <typename T, typename... Args>
+Expr make_expr_in(GraphArena* arena, Args&&... args) {
+    if (arena == nullptr) {
+        return Expr(std::make_shared<T>(std::forward<Args>(args)...));
+    }
+    T* node = new (arena->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    arena->adopt(node);
+    return Expr(std::shared_ptr<ExprAST>(std::shared_ptr<ExprAST>(), node));
+}
+
+// An operand of a node of arena, without ownership if it is in arena
+// itself, since arena would otherwise keep itself alive.
+inline Expr arena_operand(const std::shared_ptr<GraphArena>& arena, Expr operand) {
+    if (!operand.value.owner_before(arena) && !arena.owner_before(operand.value)) {
+        return Expr(std::shared_ptr<ExprAST>(std::shared_ptr<ExprAST>(), operand.value.get()));
+    }
+    return operand;
+}
+
+template <typename T>
+T&& arena_operand(const std::shared_ptr<GraphArena>& /*arena*/, T&& operand) {
+    return std::forward<T>(operand);
+}
+
+// Constructs a node in the arena of the current GraphBuilder::Scope, if any.
+// Unlike the handles of GraphBuilder, the Expr returned then keeps the arena
+// alive, so it can be stored, e.g. in a Func, after the builder is gone.
+template <typename T, typename... Args>
+Expr make_expr(Args&&... args) {
+    GraphArena* arena = GraphArena::current();
+    if (arena == nullptr) {
+        return make_expr_in<T>(nullptr, std::forward<Args>(args)...);
+    }
+    std::shared_ptr<GraphArena> owner = arena->shared_from_this();
+    Expr node = make_expr_in<T>(arena, arena_operand(owner, std::forward<Args>(args))...);
+    return Expr(std::shared_ptr<ExprAST>(owner, node.value.get()));
+}
+
+/// StaticExprTag - Base of the compile-time expression types of
+/// StaticExpr.hpp, which F::sin and F::pow also accept.
+struct StaticExprTag {};
+
 class F {
  public:
+    // Overloads for compile-time expressions, defined in StaticExpr.hpp.
+    template <typename A, typename std::enable_if<std::is_base_of<StaticExprTag, A>::value, int>::type = 0>
+    static constexpr auto sin(const A &a) -> decltype(static_sin(a)) {
+        return static_sin(a);
+    }
+
+    template <typename A, typename B, typename std::enable_if<
+        std::is_base_of<StaticExprTag, A>::value || std::is_base_of<StaticExprTag, B>::value, int>::type = 0>
+    static constexpr auto pow(const A &a, const B &b) -> decltype(static_pow(a, b)) {
+        return static_pow(a, b);
+    }
+
     static Expr sin(Expr a) {
-        std::shared_ptr<ExprAST> p(new Sin(a));
-        return Expr(p);
+        return make_expr<Sin>(std::move(a));
     }
 
     static Expr pow(Expr a, Expr b) {
-        std::shared_ptr<ExprAST> p(new Pow(a, b));
-        return Expr(p);
+        return make_expr<Pow>(std::move(a), std::move(b));
     }
 };
 
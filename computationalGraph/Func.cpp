@@ -21,46 +21,711 @@
 // SOFTWARE.
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <set>
+#include <sstream>
 #include <string>
 
 #include "Func.hpp"
+#include "IRVisitor.hpp"
+#include "ObjectExporter.hpp"
+#include "Simplifier.hpp"
+#include "ThreadPool.hpp"
 #include "Var.hpp"
 
+#include "llvm/Support/Path.h"
+
+// Func ids, which unlike addresses are never reused.
+static std::atomic<uint64_t> nextId(0);
+
 Func::Func() {
-    executionEngine = NULL;
+    id = nextId.fetch_add(1);
+    batch = NULL;
+    gradient_batch = NULL;
+    call = NULL;
+    gradient_call = NULL;
+    calls = 0;
+    jitThreshold = 0;
+    kernelWidth = 0;
+    vectorWidth = 0;
+    withGradient = false;
+    optimizationLevel = 2;
+    backgroundOptimization = false;
+    backgroundFailed = false;
+    verbose = false;
+    mathPolicy = IRVisitor::Strict;
+    mathFunctions = IRVisitor::Libm;
+    mathErrorBound = 1;
+    profileSamples = 0;
+    profiling = false;
+    profileNext = 0;
+    profileWritten = 0;
+    profileFailed = false;
 }
 
 Func::~Func() {
-    delete executionEngine;
+    if (compiler.joinable()) {
+        compiler.join();
+    }
+    if (profiler.joinable()) {
+        profiler.join();
+    }
+    release_cached_kernel();
 }
 
 double Func::operator()(std::vector<double> arg) {
-    for (int i = 0; i < arg.size(); i++) {
-        argumentsBuffer[i] = arg[i];
+    if (arg.size() != argumentPlacefolders.size()) {
+        throw 1;
+    }
+    return this->operator()(arg.data());
+}
+
+double Func::interpret(const double *arguments) {
+    if (interpreter == nullptr) {
+        throw 1;
+    }
+    count(1);
+    return interpreter->evaluate(arguments);
+}
+
+void Func::report(const std::string &message) const {
+    if (verbose) {
+        std::cerr << message << std::endl;
     }
-    auto f = reinterpret_cast<double(*)()>(executionEngine->getFunctionAddress("caller"));
-    return f();
+}
+
+// Count interpreted points, and start compiling once the threshold is
+// crossed. Exactly one caller sees the count cross it.
+void Func::count(int64_t rows) {
+    uint64_t before = calls.fetch_add(rows);
+    if (before >= jitThreshold || before + rows < jitThreshold) {
+        return;
+    }
+    compile_in_background();
+}
+
+// Compile the kernel of the optimization level on another thread, and switch
+// to it once it is ready. Whatever ran before stays usable meanwhile: the
+// code of a replaced kernel stays linked, since the JIT never unmaps it, so
+// threads still inside it finish safely.
+void Func::compile_in_background() {
+    std::string key = kernelKey;
+    unsigned width = kernelWidth;
+    compiler = std::thread([this, key, width]() {
+        try {
+            install(KernelCache::shared().insert(key, compile(width, optimizationLevel)));
+        } catch (...) {
+            backgroundFailed = true;
+            report("realise: background compile failed, keeping the current code");
+        }
+    });
+}
+
+void Func::sample(const double *arguments) {
+    uint64_t row = profileNext.fetch_add(1, std::memory_order_relaxed);
+    if (row >= profileSamples) {
+        return;
+    }
+    size_t stride = argumentPlacefolders.size();
+    std::memcpy(&profile[row * stride], arguments, stride * sizeof(double));
+    // The call which fills the last row sees the others' rows through the
+    // release sequence on profileWritten, and hands the profile off.
+    if (profileWritten.fetch_add(1, std::memory_order_acq_rel) + 1 < profileSamples) {
+        return;
+    }
+    profiling = false;
+    std::lock_guard<std::mutex> lock(profileMutex);
+    profiler = std::thread([this]() {
+        try {
+            specialize_profiled();
+        } catch (...) {
+            profileFailed = true;
+            report("profile: specializing failed, keeping the current code");
+        }
+    });
+}
+
+// The most values an argument can take to be specialized on, and the most
+// combinations of them to specialize for.
+static const size_t fewValues = 4;
+
+// Find the bindings to specialize on from the sampled argument bits. An
+// argument which took one value is bound in every specialization, and one
+// specialization is made for each combination of the arguments which took
+// a few values, if there aren't too many.
+static std::vector<std::map<int, uint64_t>> find_bindings(const std::vector<uint64_t> &profile, size_t arguments) {
+    size_t samples = profile.size() / arguments;
+    std::vector<int> invariant;
+    std::vector<int> few;
+    for (size_t k = 0; k < arguments; k++) {
+        std::set<uint64_t> values;
+        for (size_t i = 0; i < samples; i++) {
+            values.insert(profile[i * arguments + k]);
+            if (values.size() > fewValues) {
+                break;
+            }
+        }
+        if (values.size() == 1) {
+            invariant.push_back(k);
+        } else if (values.size() <= fewValues) {
+            few.push_back(k);
+        }
+    }
+
+    std::set<std::vector<uint64_t>> combinations;
+    for (size_t i = 0; i < samples; i++) {
+        std::vector<uint64_t> combination;
+        for (int k : few) {
+            combination.push_back(profile[i * arguments + k]);
+        }
+        combinations.insert(combination);
+    }
+    if (combinations.size() > fewValues) {
+        few.clear();
+        combinations = {std::vector<uint64_t>()};
+    }
+
+    std::vector<std::map<int, uint64_t>> bindings;
+    if (invariant.empty() && few.empty()) {
+        return bindings;
+    }
+    for (auto &combination : combinations) {
+        std::map<int, uint64_t> binding;
+        for (int k : invariant) {
+            binding[k] = profile[k];
+        }
+        for (size_t i = 0; i < few.size(); i++) {
+            binding[few[i]] = combination[i];
+        }
+        bindings.push_back(binding);
+    }
+    return bindings;
+}
+
+void Func::specialize_profiled() {
+    auto bindings = find_bindings(profile, argumentPlacefolders.size());
+    if (bindings.empty()) {
+        report("profile: no argument to specialize on");
+        return;
+    }
+
+    IRVisitor* visitor = new IRVisitor();
+    visitor->set_math_policy(mathPolicy);
+    visitor->set_math_functions(mathFunctions);
+    visitor->set_math_error_bound(mathErrorBound);
+    llvm::Function *callee = visitor->create_callee(argumentPlacefolders, "callee", graph);
+    std::vector<GuardedCallee> guarded;
+    for (auto &binding : bindings) {
+        Simplifier simplifier(argumentPlacefolders.size());
+        GuardedCallee special;
+        std::vector<Var> remaining;
+        for (size_t k = 0; k < argumentPlacefolders.size(); k++) {
+            auto bound = binding.find(k);
+            if (bound == binding.end()) {
+                remaining.push_back(argumentPlacefolders[k]);
+                special.remaining.push_back(k);
+                continue;
+            }
+            double value;
+            std::memcpy(&value, &bound->second, sizeof(value));
+            simplifier.bind(k, value);
+            special.bound.push_back(std::make_pair(k, value));
+        }
+        std::string name = "special" + std::to_string(guarded.size());
+        special.callee = visitor->create_callee(remaining, name, simplifier.run(graph));
+        guarded.push_back(special);
+    }
+    visitor->create_guarded_caller(callee, guarded, "caller");
+    visitor->optimize(optimizationLevel);
+
+    std::shared_ptr<Kernel> compiled(new Kernel());
+    std::vector<std::string> params = visitor->params();
+    compiled->module = JIT::shared().add(visitor->release_module(), optimizationLevel);
+    compiled->call = reinterpret_cast<void(*)(const double*, double*)>(compiled->module.address("caller"));
+    link_params(compiled.get(), params);
+    delete visitor;
+
+    if (verbose) {
+        std::ostringstream message;
+        message << "profile: specialized on " << bindings.front().size() << " arguments, "
+            << guarded.size() << " guarded callees";
+        report(message.str());
+    }
+    std::lock_guard<std::mutex> paramLock(paramMutex);
+    write_params(compiled.get());
+    std::lock_guard<std::mutex> lock(profileMutex);
+    guardedKernel = compiled;
+    call.store(compiled->call, std::memory_order_release);
+}
+
+void Func::evaluate(const std::vector<const double*> &columns, int64_t rows, double *out) {
+    if (columns.size() != argumentPlacefolders.size()) {
+        throw 1;
+    }
+    auto entry = batch.load(std::memory_order_acquire);
+    if (entry == nullptr) {
+        if (interpreter == nullptr) {
+            throw 1;
+        }
+        count(rows);
+        interpreter->evaluate(columns.data(), rows, out);
+        return;
+    }
+    entry(const_cast<const double**>(columns.data()), rows, out);
+}
+
+// The number of rows per parallel chunk, sized so that the rows of all
+// streams columns fit in a 32 KiB L1 data cache.
+static int64_t chunk_rows(size_t streams) {
+    int64_t rows = (32 * 1024) / (sizeof(double) * std::max<size_t>(streams, 1));
+    // Whole vector iterations, and not so few that scheduling dominates.
+    return std::max<int64_t>(rows / 64 * 64, 256);
+}
+
+static int64_t chunk_count(int64_t rows, int64_t grain) {
+    return rows > 0 ? (rows + grain - 1) / grain : 0;
+}
+
+void Func::evaluate_parallel(const std::vector<const double*> &columns, int64_t rows, double *out) {
+    if (columns.size() != argumentPlacefolders.size()) {
+        throw 1;
+    }
+    auto entry = batch.load(std::memory_order_acquire);
+    if (entry == nullptr) {
+        if (interpreter == nullptr) {
+            throw 1;
+        }
+        count(rows);
+    }
+    const Interpreter *fallback = interpreter.get();
+    int64_t grain = chunk_rows(columns.size() + 1);
+    // The offset column pointers of every chunk, allocated once up front.
+    // Chunk c starts at row c * grain and owns slice c of the buffer.
+    std::vector<const double*> offsets(chunk_count(rows, grain) * columns.size());
+    ThreadPool::shared().parallel_for(rows, grain, [&](int64_t begin, int64_t end) {
+        const double **chunk = offsets.data() + (begin / grain) * columns.size();
+        for (size_t i = 0; i < columns.size(); i++) {
+            chunk[i] = columns[i] + begin;
+        }
+        if (entry == nullptr) {
+            fallback->evaluate(chunk, end - begin, out + begin);
+            return;
+        }
+        entry(chunk, end - begin, out + begin);
+    });
+}
+
+std::vector<double> Func::gradient(std::vector<double> arg) {
+    if (arg.size() != argumentPlacefolders.size()) {
+        throw 1;
+    }
+    std::vector<double> result(arg.size() + 1);
+    gradient(arg.data(), result.data());
+    return result;
+}
+
+void Func::gradient(const double *arguments, double *out) const {
+    auto entry = gradient_call.load(std::memory_order_acquire);
+    if (entry == NULL) {
+        throw 1;
+    }
+    entry(arguments, out);
+}
+
+void Func::evaluate_gradient(const std::vector<const double*> &columns, int64_t rows, const std::vector<double*> &out) {
+    auto entry = gradient_batch.load(std::memory_order_acquire);
+    if (entry == NULL || columns.size() != argumentPlacefolders.size() || out.size() != argumentPlacefolders.size() + 1) {
+        throw 1;
+    }
+    entry(const_cast<const double**>(columns.data()), rows, const_cast<double**>(out.data()));
+}
+
+void Func::evaluate_gradient_parallel(const std::vector<const double*> &columns, int64_t rows, const std::vector<double*> &out) const {
+    auto kernel = gradient_batch.load(std::memory_order_acquire);
+    if (kernel == NULL || columns.size() != argumentPlacefolders.size() || out.size() != argumentPlacefolders.size() + 1) {
+        throw 1;
+    }
+    int64_t grain = chunk_rows(columns.size() + out.size());
+    int64_t chunks = chunk_count(rows, grain);
+    std::vector<const double*> offsets(chunks * columns.size());
+    std::vector<double*> outOffsets(chunks * out.size());
+    ThreadPool::shared().parallel_for(rows, grain, [&](int64_t begin, int64_t end) {
+        const double **chunk = offsets.data() + (begin / grain) * columns.size();
+        for (size_t i = 0; i < columns.size(); i++) {
+            chunk[i] = columns[i] + begin;
+        }
+        double **chunkOut = outOffsets.data() + (begin / grain) * out.size();
+        for (size_t i = 0; i < out.size(); i++) {
+            chunkOut[i] = out[i] + begin;
+        }
+        kernel(chunk, end - begin, chunkOut);
+    });
 }
 
 void Func::set_arguments(std::vector<Var> arg) {
     argumentPlacefolders.clear();
     argumentPlacefolders = arg;
-    argumentsBuffer.clear();
-    for (int i = 0; i < argumentPlacefolders.size(); i++) {
-        argumentsBuffer.push_back(static_cast<double>(0));
-    }
+
+    // They were made from the previous expression.
+    std::lock_guard<std::mutex> lock(specializationsMutex);
+    specializations.clear();
 }
 
-void Func::realise() {
-    using llvm::Function;
-    using llvm::FunctionType;
-    using llvm::BasicBlock;
-    using llvm::Type;
+Func& Func::specialize(const std::vector<std::pair<Var, double>> &bindings) {
+    std::map<std::string, int> name2Index;
+    for (size_t i = 0; i < argumentPlacefolders.size(); i++) {
+        name2Index[argumentPlacefolders[i].name] = i;
+    }
+    std::map<int, double> index2Value;
+    for (auto &binding : bindings) {
+        auto found = name2Index.find(binding.first.name);
+        if (found == name2Index.end()) {
+            // Not an argument of this Func.
+            throw 1;
+        }
+        index2Value[found->second] = binding.second;
+    }
+    std::vector<std::pair<int, uint64_t>> key;
+    for (auto &bound : index2Value) {
+        uint64_t bits;
+        std::memcpy(&bits, &bound.second, sizeof(bits));
+        key.push_back(std::make_pair(bound.first, bits));
+    }
 
+    std::lock_guard<std::mutex> lock(specializationsMutex);
+    auto found = specializations.find(key);
+    if (found != specializations.end()) {
+        return *found->second;
+    }
+
+    Simplifier simplifier(argumentPlacefolders.size());
+    std::vector<Var> remaining;
+    for (size_t i = 0; i < argumentPlacefolders.size(); i++) {
+        auto bound = index2Value.find(i);
+        if (bound == index2Value.end()) {
+            remaining.push_back(argumentPlacefolders[i]);
+        } else {
+            simplifier.bind(i, bound->second);
+        }
+    }
+
+    std::unique_ptr<Func> specialized(new Func());
+    specialized->set_arguments(remaining);
+    specialized->reassociator = reassociator;
+    specialized->graph = reassociator.run(simplifier.run(lowered()));
+    specialized->vectorWidth = vectorWidth;
+    specialized->optimizationLevel = optimizationLevel;
+    specialized->mathPolicy = mathPolicy;
+    specialized->mathFunctions = mathFunctions;
+    specialized->mathErrorBound = mathErrorBound;
+    specialized->jitThreshold = jitThreshold;
+    specialized->backgroundOptimization = backgroundOptimization;
+    specialized->verbose = verbose;
+    {
+        std::lock_guard<std::mutex> paramLock(paramMutex);
+        specialized->paramValues = paramValues;
+    }
+    if (withGradient) {
+        specialized->realise_with_gradient();
+    } else {
+        specialized->realise();
+    }
+    Func &result = *specialized;
+    specializations[key] = std::move(specialized);
+    return result;
+}
+
+std::shared_ptr<Kernel> Func::compile(unsigned width, unsigned level) {
+    auto start = std::chrono::steady_clock::now();
     IRVisitor* visitor = new IRVisitor();
-    llvm::Function* callee = visitor->create_callee(argumentPlacefolders, "callee", expr);
-    llvm::Function* caller = visitor->create_caller(callee, argumentsBuffer, "caller");
-    executionEngine = visitor->create_engine();
+    visitor->set_math_policy(mathPolicy);
+    visitor->set_math_functions(mathFunctions);
+    visitor->set_math_error_bound(mathErrorBound);
+    llvm::Function *callee = visitor->create_callee(argumentPlacefolders, "callee", graph);
+    visitor->create_caller(callee, "caller");
+    visitor->create_batch(argumentPlacefolders, "batch", graph, width);
+    if (withGradient) {
+        llvm::Function *gradient = visitor->create_gradient(argumentPlacefolders, "gradient", graph, width);
+        visitor->create_gradient_caller(gradient, argumentPlacefolders.size(), "gradient_caller");
+    }
+    auto generated = std::chrono::steady_clock::now();
+
+    // The object cached on disk is keyed by the unoptimized module, so that
+    // a warm start skips optimization as well as codegen. It is read once
+    // and linked as it is, so the object linked is the one validated, and a
+    // miss always optimizes what the JIT then compiles and stores.
+    DiskObjectCache *diskCache = KernelCache::shared().disk_cache();
+    std::unique_ptr<llvm::MemoryBuffer> object;
+    if (diskCache != nullptr) {
+        llvm::Module *module = visitor->module.get();
+        module->setModuleIdentifier(DiskObjectCache::content_identifier(*module) + "-O" + std::to_string(level));
+        std::string discarded;
+        object = diskCache->lookup(module, &discarded);
+        if (!discarded.empty()) {
+            report("realise: disk cache " + discarded);
+        }
+    }
+    bool cached = object != nullptr;
+    if (!cached) {
+        visitor->optimize(level);
+    }
+    auto optimized = std::chrono::steady_clock::now();
+
+    std::shared_ptr<Kernel> compiled(new Kernel());
+    std::vector<std::string> params = visitor->params();
+    if (cached) {
+        compiled->module = JIT::shared().add_object(std::move(object), level);
+    } else {
+        compiled->module = JIT::shared().add(visitor->release_module(), level);
+    }
+
+    // Resolve the entry points once, so that calls don't pay for the lookup.
+    // The first lookup generates the code.
+    compiled->batch = reinterpret_cast<void(*)(const double**, int64_t, double*)>(compiled->module.address("batch"));
+    compiled->call = reinterpret_cast<void(*)(const double*, double*)>(compiled->module.address("caller"));
+    if (withGradient) {
+        compiled->gradient = reinterpret_cast<void(*)(const double**, int64_t, double**)>(compiled->module.address("gradient"));
+        compiled->gradient_call = reinterpret_cast<void(*)(const double*, double*)>(compiled->module.address("gradient_caller"));
+    }
+    link_params(compiled.get(), params);
+    auto finished = std::chrono::steady_clock::now();
+
+    // Published under the lock, since a background compile finishes while
+    // the caller may be reading them.
+    typedef std::chrono::duration<double, std::milli> milliseconds;
+    CompileTimings stages;
+    stages.irgen = milliseconds(generated - start).count();
+    stages.optimize = milliseconds(optimized - generated).count();
+    stages.codegen = milliseconds(finished - optimized).count();
+    {
+        std::lock_guard<std::mutex> lock(timingsMutex);
+        timings = stages;
+    }
+    if (verbose) {
+        std::ostringstream message;
+        message << "realise: O" << level << (cached ? " (disk cache)" : "")
+            << " irgen " << stages.irgen << " ms"
+            << ", optimize " << stages.optimize << " ms"
+            << ", codegen " << stages.codegen << " ms";
+        report(message.str());
+    }
 
     delete visitor;
-}
\ No newline at end of file
+    return compiled;
+}
+
+// expr lowered into a Graph, simplified and reassociated. A specialization
+// has no expr, and keeps the graph it was made with.
+Graph Func::lowered() const {
+    if (expr.value == nullptr) {
+        return graph;
+    }
+    return reassociator.run(Simplifier(argumentPlacefolders.size()).run(Graph(argumentPlacefolders, {expr})));
+}
+
+std::string Func::options(unsigned width) const {
+    std::string options = "width=" + std::to_string(width)
+        + ",O" + std::to_string(optimizationLevel)
+        + (withGradient ? ",gradient" : "")
+        + (mathPolicy != IRVisitor::Strict ? ",math=" + std::to_string(mathPolicy) : "")
+        + (mathFunctions == IRVisitor::Inline ? ",inline,ulps=" + std::to_string(mathErrorBound) : "");
+    // The values of Params live in the kernel, so a Func which has any
+    // can't share it with another.
+    if (graph.parameters() > 0) {
+        options += ",params=" + std::to_string(id);
+    }
+    return options;
+}
+
+// Drop the kernel only this Func can use from the KernelCache.
+void Func::release_cached_kernel() {
+    if (!kernelKey.empty() && graph.parameters() > 0) {
+        KernelCache::shared().erase(kernelKey);
+    }
+}
+
+void Func::realise_with_gradient() {
+    withGradient = true;
+    realise();
+}
+
+void Func::install(std::shared_ptr<Kernel> compiled) {
+    std::lock_guard<std::mutex> paramLock(paramMutex);
+    kernel = compiled;
+    write_params(compiled.get());
+    gradient_batch.store(compiled->gradient, std::memory_order_release);
+    gradient_call.store(compiled->gradient_call, std::memory_order_release);
+    batch.store(compiled->batch, std::memory_order_release);
+    // A guarded caller from value profiling stays, having a general callee
+    // of the full optimization level itself.
+    std::lock_guard<std::mutex> lock(profileMutex);
+    if (guardedKernel == nullptr) {
+        call.store(compiled->call, std::memory_order_release);
+    }
+}
+
+void Func::realise() {
+    if (compiler.joinable()) {
+        compiler.join();
+    }
+    if (profiler.joinable()) {
+        profiler.join();
+    }
+    release_cached_kernel();
+    {
+        // set_param reads them under the lock.
+        std::lock_guard<std::mutex> lock(paramMutex);
+        guardedKernel.reset();
+        interpreter.reset();
+    }
+    // Allocated up front, so that sample() only ever writes into it.
+    profile.assign(profileSamples * argumentPlacefolders.size(), 0);
+    profileNext = 0;
+    profileWritten = 0;
+    profiling = profileSamples > 0 && !argumentPlacefolders.empty();
+    profileFailed = false;
+    batch = NULL;
+    call = NULL;
+    gradient_batch = NULL;
+    gradient_call = NULL;
+    calls = 0;
+    backgroundFailed = false;
+
+    kernelWidth = vectorWidth > 0 ? vectorWidth : IRVisitor::host_vector_width();
+
+    // Reuse the machine code of a structurally equal expression if there is one.
+    graph = lowered();
+    kernelKey = KernelCache::key(graph, options(kernelWidth));
+    std::shared_ptr<Kernel> found = KernelCache::shared().find(kernelKey);
+    if (found != nullptr || (jitThreshold > 0 && !withGradient)) {
+        std::lock_guard<std::mutex> lock(timingsMutex);
+        timings = CompileTimings();
+    }
+    if (found != nullptr) {
+        report("realise: kernel cache hit");
+        install(found);
+    } else if (jitThreshold > 0 && !withGradient) {
+        std::lock_guard<std::mutex> lock(paramMutex);
+        interpreter.reset(new Interpreter(graph));
+        for (auto &param : paramValues) {
+            interpreter->set_param(param.first, param.second);
+        }
+    } else if (backgroundOptimization && optimizationLevel > 0) {
+        // The quick kernel isn't cached, so that the cache only ever hands
+        // out kernels of the level they were asked for.
+        install(compile(kernelWidth, 0));
+        compile_in_background();
+    } else {
+        install(KernelCache::shared().insert(kernelKey, compile(kernelWidth, optimizationLevel)));
+    }
+}
+
+void Func::realise_all(const std::vector<Func*> &funcs, unsigned threads) {
+    if (threads == 1) {
+        for (auto func : funcs) {
+            func->realise();
+        }
+        return;
+    }
+    // The calling thread is one of the compile threads.
+    ThreadPool pool(threads > 1 ? threads - 1 : 0);
+    // A Func that fails to compile doesn't stop the others; the first
+    // failure is rethrown once all of them have been tried.
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    pool.parallel_for(funcs.size(), 1, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; i++) {
+            try {
+                funcs[i]->realise();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void Func::link_params(Kernel *compiled, const std::vector<std::string> &names) {
+    for (auto &name : names) {
+        compiled->params[name] = reinterpret_cast<double*>(compiled->module.address(IRVisitor::param_symbol(name)));
+    }
+}
+
+// Give every Param of the kernel its value: the one given to set_param, or
+// else the one it was made with, since a kernel found in the KernelCache may
+// hold values from before. The caller holds paramMutex.
+void Func::write_params(Kernel *compiled) {
+    std::map<std::string, double> values;
+    for (size_t slot = 0; slot < graph.parameters(); slot++) {
+        values[graph.parameter_name(slot)] = graph.parameter_value(slot);
+    }
+    for (auto &param : paramValues) {
+        values[param.first] = param.second;
+    }
+    for (auto &param : compiled->params) {
+        auto found = values.find(param.first);
+        if (found != values.end()) {
+            *param.second = found->second;
+        }
+    }
+}
+
+// Set the Param in everything this Func runs, returning whether any of it
+// reads the Param.
+bool Func::apply_param(const std::string &name, double value) {
+    bool found = false;
+    std::lock_guard<std::mutex> specializationsLock(specializationsMutex);
+    for (auto &specialization : specializations) {
+        found = specialization.second->apply_param(name, value) || found;
+    }
+
+    std::lock_guard<std::mutex> lock(paramMutex);
+    paramValues[name] = value;
+    for (auto compiled : {kernel, guardedKernel}) {
+        if (compiled == nullptr) {
+            continue;
+        }
+        auto param = compiled->params.find(name);
+        if (param != compiled->params.end()) {
+            *param->second = value;
+            found = true;
+        }
+    }
+    if (interpreter != nullptr && interpreter->set_param(name, value)) {
+        found = true;
+    }
+    return found;
+}
+
+void Func::set_param(const std::string &name, double value) {
+    bool realised;
+    {
+        // realise() and install() replace them under the lock.
+        std::lock_guard<std::mutex> lock(paramMutex);
+        realised = kernel != nullptr || interpreter != nullptr;
+    }
+    if (!apply_param(name, value) && realised) {
+        // Not a Param of this Func.
+        throw 1;
+    }
+}
+
+void Func::emit_object(const std::string &path, const std::string &name,
+                       const std::string &cpu, const std::string &features) {
+    ObjectExporter exporter(optimizationLevel);
+    exporter.set_target(cpu, features, 2);
+    exporter.add(name, *this);
+    exporter.write_object(path);
+
+    llvm::SmallString<256> headerPath(path);
+    llvm::sys::path::replace_extension(headerPath, "h");
+    exporter.write_header(std::string(headerPath.str()));
+}
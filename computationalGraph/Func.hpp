@@ -23,12 +23,23 @@
 #ifndef FUNC_HPP_
 #define FUNC_HPP_
 
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <utility>
 #include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "ExprAST.hpp"
 #include "Expr.hpp"
+#include "Graph.hpp"
+#include "Interpreter.hpp"
+#include "IRVisitor.hpp"
+#include "KernelCache.hpp"
+#include "Reassociator.hpp"
 #include "Var.hpp"
 
 #include "llvm/ADT/STLExtras.h"
@@ -40,12 +51,90 @@
 
 class Var;
 
+/// CompileTimings - Milliseconds spent in each stage of the last realise().
+/// They are all zero when the kernel was found in the KernelCache.
+struct CompileTimings {
+    double irgen = 0;
+    double optimize = 0;
+    double codegen = 0;
+};
+
 class Func {
+    friend class ObjectExporter;
+
  private:
     Expr expr;
-    std::vector<double> argumentsBuffer;
-    llvm::ExecutionEngine *executionEngine;
+    // expr lowered and simplified, which is what realise() generates code
+    // for. A specialization is made with it instead of with expr.
+    Graph graph;
+    std::shared_ptr<Kernel> kernel;
     std::vector<Var> argumentPlacefolders;
+    // Set atomically, since a kernel compiled in the background replaces
+    // the interpreter or a quick kernel while other threads are calling.
+    std::atomic<void (*)(const double **columns, int64_t rows, double *out)> batch;
+    std::atomic<void (*)(const double **columns, int64_t rows, double **out)> gradient_batch;
+    std::atomic<void (*)(const double *arguments, double *out)> call;
+    std::atomic<void (*)(const double *arguments, double *out)> gradient_call;
+    // Evaluates the expression until the kernel is ready.
+    std::unique_ptr<Interpreter> interpreter;
+    std::atomic<uint64_t> calls;
+    uint64_t jitThreshold;
+    std::string kernelKey;
+    unsigned kernelWidth;
+    std::thread compiler;
+    // Set when the background compile threw, and the code it was to replace
+    // is still in use.
+    std::atomic<bool> backgroundFailed;
+    // Specializations by the bit patterns of the values bound to each
+    // argument index.
+    std::map<std::vector<std::pair<int, uint64_t>>, std::unique_ptr<Func>> specializations;
+    std::mutex specializationsMutex;
+    // Value profiling: the argument bits of the first profileSamples calls,
+    // one row of arguments per call, and the kernel with the guarded caller
+    // built from them. A call claims a row through profileNext and counts it
+    // in profileWritten once filled, so that recording takes no lock.
+    uint64_t profileSamples;
+    std::atomic<bool> profiling;
+    std::atomic<uint64_t> profileNext;
+    std::atomic<uint64_t> profileWritten;
+    std::mutex profileMutex;
+    std::vector<uint64_t> profile;
+    std::thread profiler;
+    // Set when building the guarded kernel threw, and the general kernel
+    // is still in use.
+    std::atomic<bool> profileFailed;
+    std::shared_ptr<Kernel> guardedKernel;
+    // Values given to set_param, which every newly installed kernel gets.
+    std::map<std::string, double> paramValues;
+    std::mutex paramMutex;
+    // Tells the kernels of Funcs with Params apart in the KernelCache.
+    uint64_t id;
+    unsigned vectorWidth;
+    bool withGradient;
+    unsigned optimizationLevel;
+    bool backgroundOptimization;
+    bool verbose;
+    Reassociator reassociator;
+    IRVisitor::MathPolicy mathPolicy;
+    IRVisitor::MathFunctions mathFunctions;
+    unsigned mathErrorBound;
+    CompileTimings timings;
+    mutable std::mutex timingsMutex;
+
+    std::shared_ptr<Kernel> compile(unsigned width, unsigned level);
+    Graph lowered() const;
+    std::string options(unsigned width) const;
+    void install(std::shared_ptr<Kernel> compiled);
+    void write_params(Kernel *compiled);
+    void release_cached_kernel();
+    void count(int64_t rows);
+    void compile_in_background();
+    void report(const std::string &message) const;
+    double interpret(const double *arguments);
+    void sample(const double *arguments);
+    void specialize_profiled();
+    bool apply_param(const std::string &name, double value);
+    static void link_params(Kernel *compiled, const std::vector<std::string> &names);
 
  public:
     Func();
@@ -53,6 +142,112 @@ class Func {
 
     void realise();
 
+    // realise() which also compiles a kernel for the gradient.
+    void realise_with_gradient();
+
+    // Realise every Func on threads compile threads, 0 meaning one per
+    // hardware thread. Each compiles in a context of its own. If any of
+    // them throws, the rest are still realised and the first exception is
+    // rethrown afterwards.
+    static void realise_all(const std::vector<Func*> &funcs, unsigned threads = 0);
+
+    // Set the number of lanes used by the batch kernel. 0 picks it from the host CPU.
+    void set_vector_width(unsigned width) { vectorWidth = width; }
+
+    // Interpret the expression until it has been evaluated at threshold
+    // points, then compile it on a background thread and switch to the
+    // kernel. 0, the default, compiles in realise(). Gradients are always
+    // compiled in realise().
+    void set_jit_threshold(uint64_t threshold) { jitThreshold = threshold; }
+
+    // Compile an unoptimized kernel in realise(), which is much faster, and
+    // swap in the kernel of the optimization level from a background thread
+    // once it is ready.
+    void set_background_optimization(bool enabled) { backgroundOptimization = enabled; }
+
+    // Whether the background compile since the last realise() failed, which
+    // leaves the interpreter or the quick kernel in use.
+    bool background_compile_failed() const { return backgroundFailed.load(); }
+
+    // Record the arguments of the first samples single point calls. Then
+    // the arguments which were invariant, or took only a few values, are
+    // bound in specialized callees, and calls switch to a caller which
+    // checks the arguments against the bound values and takes the matching
+    // specialized callee, falling back to the general one. Compiled in the
+    // background. 0, the default, turns profiling off.
+    void set_value_profiling(uint64_t samples) { profileSamples = samples; }
+
+    // Whether specializing on the profile since the last realise() failed,
+    // which leaves the general kernel in use.
+    bool value_profiling_failed() const { return profileFailed.load(); }
+
+    // Whether calls run compiled code, rather than the interpreter.
+    bool is_compiled() const { return call.load() != nullptr; }
+
+    // Set the optimization level, 0 to 3, used by realise(). The default is 2.
+    void set_optimization_level(unsigned level) { optimizationLevel = level; }
+
+    // Describe compiles and the other decisions of the JIT on std::cerr.
+    // Off by default.
+    void set_verbose(bool enabled) { verbose = enabled; }
+
+    // Rebuild long chains of + and * so that their operations can run in
+    // parallel, at the price of rounding differently. Off by default; see
+    // Reassociator for the strategies. Takes effect from the next realise().
+    //
+    //   f.set_reassociation(Reassociator::Pairwise);
+    void set_reassociation(Reassociator::Strategy strategy, unsigned accumulators = 4) {
+        reassociator = Reassociator(strategy, accumulators);
+    }
+
+    // How far the kernels may depart from IEEE semantics for speed, e.g. to
+    // fuse multiplications and additions into FMAs. The default, Strict,
+    // computes what the interpreter does, unless the Inline math functions
+    // are chosen too. Takes effect from the next realise().
+    void set_math_policy(IRVisitor::MathPolicy policy) { mathPolicy = policy; }
+
+    // What sin, cos, exp, log and pow in the kernels call. The default, Libm,
+    // computes what the interpreter does; Inline calls the vector code of
+    // MathLibrary within the math error bound instead.
+    //
+    //   f.set_math_functions(IRVisitor::Inline);
+    //   f.set_math_error_bound(8);
+    void set_math_functions(IRVisitor::MathFunctions functions) { mathFunctions = functions; }
+
+    // The error bound in ulps of the Inline math functions, which are within
+    // 1 ulp below 4 ulps and trade accuracy for speed from 4 ulps on. The
+    // Libm functions don't depend on it.
+    void set_math_error_bound(unsigned ulps) { mathErrorBound = ulps; }
+
+    CompileTimings compile_timings() const {
+        std::lock_guard<std::mutex> lock(timingsMutex);
+        return timings;
+    }
+
+    // A Func of the remaining arguments, in their original order, with the
+    // given values substituted for the bound ones and then simplified, so
+    // that subtrees of bound arguments are computed once here instead of on
+    // every call. It is realised with the options of this Func and kept
+    // until the arguments of this Func are set again, so that binding the
+    // same values again returns it at once.
+    //
+    //   Func& g = f.specialize({{coefficient, 0.5}});
+    //   g(x);
+    Func& specialize(const std::vector<std::pair<Var, double>> &bindings);
+
+    // Change the value of the Param name, which all kernels, the interpreter
+    // and the specializations of this Func read from then on, without
+    // compiling anything. A call running meanwhile sees the old or the new
+    // value.
+    void set_param(const std::string &name, double value);
+
+    // Compile ahead of time into the object file path, exporting the function
+    // as name and name_batch, and write a C header declaring them next to it.
+    // The object targets cpu with features, the generic CPU by default; Funcs
+    // without a vector width use 2 lanes, or the host's width for "host".
+    void emit_object(const std::string &path, const std::string &name,
+                     const std::string &cpu = "generic", const std::string &features = "");
+
     Expr& operator()(std::vector<Var> arg) {
         this->set_arguments(arg);
         return expr;
@@ -60,9 +255,49 @@ class Func {
 
     double operator()(std::vector<double>);
 
+    // Evaluate one point given one value per argument. This and the other
+    // evaluation methods only read the compiled kernel, so a realised Func
+    // can be called from many threads at once.
+    double operator()(const double *arguments) {
+        if (profiling.load(std::memory_order_relaxed)) {
+            sample(arguments);
+        }
+        auto entry = call.load(std::memory_order_acquire);
+        if (entry == nullptr) {
+            return interpret(arguments);
+        }
+        double result;
+        entry(arguments, &result);
+        return result;
+    }
+
+    // Evaluate rows points at once. columns holds one input array per argument
+    // (structure-of-arrays) and the results are written to out[0..rows).
+    void evaluate(const std::vector<const double*> &columns, int64_t rows, double *out);
+
+    // evaluate() spread over the threads of ThreadPool::shared(), in chunks
+    // of rows small enough for their columns to stay in cache.
+    void evaluate_parallel(const std::vector<const double*> &columns, int64_t rows, double *out);
+
+    // Returns the value followed by the partial derivative with respect to
+    // each argument. Requires realise_with_gradient().
+    std::vector<double> gradient(std::vector<double>);
+
+    // gradient() writing the value and the partial derivatives to out, which
+    // holds arguments + 1 doubles.
+    void gradient(const double *arguments, double *out) const;
+
+    // Batch version of gradient. out holds arguments + 1 output arrays, for
+    // the values and for the partial derivatives of each argument.
+    void evaluate_gradient(const std::vector<const double*> &columns, int64_t rows, const std::vector<double*> &out);
+    void evaluate_gradient_parallel(const std::vector<const double*> &columns, int64_t rows, const std::vector<double*> &out) const;
+
     template <typename... Args>
     double operator() (double x, Args&&... args) {
-        std::vector<double> collected_args{x, std::forward<Args>(args)...};
+        const double collected_args[] = {x, static_cast<double>(args)...};
+        if (sizeof...(Args) + 1 != argumentPlacefolders.size()) {
+            throw 1;
+        }
         return this->operator()(collected_args);
     }
     void set_arguments(std::vector<Var>);
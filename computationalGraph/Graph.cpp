@@ -0,0 +1,270 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#include "Graph.hpp"
+#include "ExprAST.hpp"
+
+Graph::Graph(unsigned arguments) : argumentCount(arguments) {
+}
+
+Graph::Graph(const std::vector<Var> &argumentPlacefolders, const std::vector<Expr> &outputs)
+    : argumentCount(static_cast<unsigned>(argumentPlacefolders.size())) {
+    Lowering lowering(this, argumentPlacefolders);
+    for (auto &output : outputs) {
+        add_output(lowering.visit(output));
+    }
+}
+
+// + and * are commutative, so a + b and b + a are the same node.
+size_t Graph::hash(const Node &node) {
+    uint64_t bits;
+    std::memcpy(&bits, &node.constant, sizeof(bits));
+    uint32_t a = static_cast<uint32_t>(node.a);
+    uint32_t b = static_cast<uint32_t>(node.b);
+    if (is_commutative(node.opcode) && b < a) {
+        std::swap(a, b);
+    }
+    // Mix every field into every bit, with the finalizer of splitmix64.
+    uint64_t hash = bits ^ (static_cast<uint64_t>(a) << 32 | b) ^ node.opcode * 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return static_cast<size_t>(hash ^ (hash >> 31));
+}
+
+bool Graph::equal(const Node &left, const Node &right) {
+    if (left.opcode != right.opcode || std::memcmp(&left.constant, &right.constant, sizeof(double)) != 0) {
+        return false;
+    }
+    if (left.a == right.a && left.b == right.b) {
+        return true;
+    }
+    return is_commutative(left.opcode) && left.a == right.b && left.b == right.a;
+}
+
+void Graph::grow() {
+    table.assign(std::max<size_t>(64, table.size() * 2), -1);
+    size_t mask = table.size() - 1;
+    for (size_t i = 0; i < nodeList.size(); i++) {
+        size_t entry = hash(nodeList[i]) & mask;
+        while (table[entry] >= 0) {
+            entry = (entry + 1) & mask;
+        }
+        table[entry] = static_cast<int32_t>(i);
+    }
+}
+
+int Graph::append(Opcode opcode, int a, int b, double constant) {
+    if ((nodeList.size() + 1) * 2 > table.size()) {
+        grow();
+    }
+    Node node{opcode, a, b, constant};
+    size_t mask = table.size() - 1;
+    for (size_t entry = hash(node) & mask;; entry = (entry + 1) & mask) {
+        int32_t index = table[entry];
+        if (index < 0) {
+            table[entry] = static_cast<int32_t>(nodeList.size());
+            nodeList.push_back(node);
+            return table[entry];
+        }
+        if (equal(nodeList[index], node)) {
+            return index;
+        }
+    }
+}
+
+int Graph::argument(int slot) {
+    if (slot < 0 || slot >= static_cast<int>(argumentCount)) {
+        throw 1;
+    }
+    return append(Argument, slot, -1, 0);
+}
+
+int Graph::constant(double value) {
+    return append(Constant, -1, -1, value);
+}
+
+int Graph::parameter(const std::string &name, double value) {
+    auto inserted = name2Parameter.insert(std::make_pair(name, static_cast<int>(parameterNames.size())));
+    if (inserted.second) {
+        parameterNames.push_back(name);
+        parameterValues.push_back(value);
+    } else if (parameterValues[inserted.first->second] != value) {
+        // Two Params of one name would share a slot, and so a value.
+        throw 1;
+    }
+    return append(Parameter, inserted.first->second, -1, 0);
+}
+
+int Graph::operation(Opcode opcode, int a, int b) {
+    return append(opcode, a, arity(opcode) > 1 ? b : -1, 0);
+}
+
+int Graph::arity(Opcode opcode) {
+    switch (opcode) {
+    case Argument:
+    case Parameter:
+    case Constant:
+        return 0;
+    case Sine:
+        return 1;
+    case Add:
+    case Multiply:
+    case Divide:
+    case Power:
+        return 2;
+    }
+    return 0;
+}
+
+bool Graph::is_constant(int index, double *value) const {
+    if (nodeList[index].opcode != Constant) {
+        return false;
+    }
+    *value = nodeList[index].constant;
+    return true;
+}
+
+Graph Graph::prune() const {
+    std::vector<bool> live(nodeList.size(), false);
+    for (int output : outputList) {
+        live[output] = true;
+    }
+    for (int i = static_cast<int>(nodeList.size()) - 1; i >= 0; i--) {
+        if (!live[i]) {
+            continue;
+        }
+        const Node &node = nodeList[i];
+        int operands = arity(node.opcode);
+        if (operands > 0) {
+            live[node.a] = true;
+        }
+        if (operands > 1) {
+            live[node.b] = true;
+        }
+    }
+
+    Graph pruned(argumentCount);
+    std::vector<int> remap(nodeList.size(), -1);
+    for (size_t i = 0; i < nodeList.size(); i++) {
+        if (!live[i]) {
+            continue;
+        }
+        const Node &node = nodeList[i];
+        switch (node.opcode) {
+        case Argument:
+            remap[i] = pruned.argument(node.a);
+            break;
+        case Parameter:
+            remap[i] = pruned.parameter(parameterNames[node.a], parameterValues[node.a]);
+            break;
+        case Constant:
+            remap[i] = pruned.constant(node.constant);
+            break;
+        default:
+            remap[i] = pruned.operation(node.opcode, remap[node.a], node.b >= 0 ? remap[node.b] : -1);
+            break;
+        }
+    }
+    for (int output : outputList) {
+        pruned.add_output(remap[output]);
+    }
+    return pruned;
+}
+
+void Graph::dump() const {
+    static const char *names[] = {"arg", "param", "const", "add", "mul", "div", "sin", "pow"};
+    for (size_t i = 0; i < nodeList.size(); i++) {
+        const Node &node = nodeList[i];
+        std::cout << "%" << i << " = " << names[node.opcode];
+        switch (node.opcode) {
+        case Argument:
+            std::cout << " " << node.a;
+            break;
+        case Parameter:
+            std::cout << " " << parameterNames[node.a];
+            break;
+        case Constant:
+            std::cout << " " << node.constant;
+            break;
+        default:
+            std::cout << " %" << node.a;
+            if (node.b >= 0) {
+                std::cout << ", %" << node.b;
+            }
+            break;
+        }
+        std::cout << std::endl;
+    }
+    for (int output : outputList) {
+        std::cout << "ret %" << output << std::endl;
+    }
+}
+
+Lowering::Lowering(Graph *graph, const std::vector<Var> &argumentPlacefolders) : target(graph) {
+    for (size_t i = 0; i < argumentPlacefolders.size(); i++) {
+        name2Slot[argumentPlacefolders[i].name] = i;
+    }
+}
+
+// Post-order walk with an explicit stack: a node is lowered when it is seen
+// the second time, once its operands have been.
+int Lowering::visit(Expr expr) {
+    std::vector<std::pair<ExprAST*, bool>> stack = {std::make_pair(expr.value.get(), false)};
+    while (!stack.empty()) {
+        ExprAST *node = stack.back().first;
+        if (node2Index.count(node) > 0) {
+            stack.pop_back();
+            continue;
+        }
+        if (!stack.back().second) {
+            stack.back().second = true;
+            std::vector<Expr> operands = node->operands();
+            for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+                if (node2Index.count(it->value.get()) == 0) {
+                    stack.push_back(std::make_pair(it->value.get(), false));
+                }
+            }
+            continue;
+        }
+        stack.pop_back();
+        node2Index[node] = node->lower(this);
+    }
+    return node2Index[expr.value.get()];
+}
+
+int Lowering::index(const Expr &operand) const {
+    return node2Index.at(operand.value.get());
+}
+
+int Lowering::variable(const std::string &name) {
+    auto found = name2Slot.find(name);
+    if (found == name2Slot.end()) {
+        // A variable which is not an argument of the function.
+        throw 1;
+    }
+    return target->argument(found->second);
+}
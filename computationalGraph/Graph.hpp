@@ -0,0 +1,128 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GRAPH_HPP_
+#define GRAPH_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Expr.hpp"
+#include "Var.hpp"
+
+class ExprAST;
+
+/// Graph - Flat SSA form of one or more expressions, which everything from
+/// simplification to code generation works on.
+///
+/// Nodes are stored in topological order: the operands of a node always
+/// have lower indices, so a forward scan visits operands before their users
+/// and a backward scan users before their operands. Variables are interned
+/// to the slot of their argument, and Params to a parameter slot. Equal
+/// nodes are created only once, so structurally equal subtrees are shared.
+class Graph {
+ public:
+    enum Opcode : uint8_t { Argument, Parameter, Constant, Add, Multiply, Divide, Sine, Power };
+
+    struct Node {
+        Opcode opcode;
+        // Operand indices, or the argument or parameter slot in a.
+        int32_t a;
+        int32_t b;
+        double constant;
+    };
+
+ private:
+    std::vector<Node> nodeList;
+    // Open addressing table of node indices, -1 for free entries, which is
+    // kept at most half full.
+    std::vector<int32_t> table;
+    std::vector<int> outputList;
+    std::vector<std::string> parameterNames;
+    std::vector<double> parameterValues;
+    std::unordered_map<std::string, int> name2Parameter;
+    unsigned argumentCount;
+
+    static size_t hash(const Node &node);
+    static bool equal(const Node &left, const Node &right);
+    void grow();
+    int append(Opcode opcode, int a, int b, double constant);
+
+ public:
+    explicit Graph(unsigned arguments = 0);
+    // Lower outputs, whose variables are argumentPlacefolders, into a graph.
+    // A subtree shared between them is lowered once.
+    Graph(const std::vector<Var> &argumentPlacefolders, const std::vector<Expr> &outputs);
+
+    // Each returns the index of the node, which is an existing one if an
+    // equal node is already in the graph.
+    int argument(int slot);
+    int constant(double value);
+    // Params are told apart by name, so one of a name already in the graph
+    // with another start value throws.
+    int parameter(const std::string &name, double value);
+    int operation(Opcode opcode, int a, int b = -1);
+    void add_output(int node) { outputList.push_back(node); }
+
+    const Node& operator[](int index) const { return nodeList[index]; }
+    size_t size() const { return nodeList.size(); }
+    const std::vector<Node>& nodes() const { return nodeList; }
+    const std::vector<int>& outputs() const { return outputList; }
+    unsigned arguments() const { return argumentCount; }
+    size_t parameters() const { return parameterNames.size(); }
+    const std::string& parameter_name(int slot) const { return parameterNames[slot]; }
+    double parameter_value(int slot) const { return parameterValues[slot]; }
+    bool is_constant(int index, double *value) const;
+
+    // The number of operands of opcode.
+    static int arity(Opcode opcode);
+    static bool is_commutative(Opcode opcode) { return opcode == Add || opcode == Multiply; }
+
+    // A copy without the nodes no output depends on.
+    Graph prune() const;
+    void dump() const;
+};
+
+/// Lowering - Translates Exprs into a Graph. Each ExprAST node is lowered
+/// once, however often it is shared, and after all of its operands.
+class Lowering {
+    Graph *target;
+    std::map<std::string, int> name2Slot;
+    std::unordered_map<ExprAST*, int> node2Index;
+
+ public:
+    Lowering(Graph *graph, const std::vector<Var> &argumentPlacefolders);
+
+    // Lower expr, returning its node.
+    int visit(Expr expr);
+    // The node an operand was lowered to.
+    int index(const Expr &operand) const;
+    int variable(const std::string &name);
+    Graph* graph() { return target; }
+};
+
+#endif  // GRAPH_HPP_
@@ -0,0 +1,81 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "GraphArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "ExprAST.hpp"
+
+const size_t GraphArena::blockSize;
+
+static thread_local GraphArena* currentArena = nullptr;
+
+GraphArena::GraphArena() : cursor(nullptr), end(nullptr) {
+}
+
+GraphArena::~GraphArena() {
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+        (*it)->~ExprAST();
+    }
+}
+
+void* GraphArena::allocate(size_t size, size_t alignment) {
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (cursor == nullptr || aligned + size > reinterpret_cast<uintptr_t>(end)) {
+        // Nodes larger than a block get one of their own.
+        size_t capacity = std::max(blockSize, size + alignment);
+        blocks.emplace_back(new char[capacity]);
+        blockSizes.push_back(capacity);
+        cursor = blocks.back().get();
+        end = cursor + capacity;
+        aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+    cursor = reinterpret_cast<char*>(aligned + size);
+    return reinterpret_cast<void*>(aligned);
+}
+
+void GraphArena::adopt(ExprAST* node) {
+    nodes.push_back(node);
+}
+
+bool GraphArena::contains(const void* p) const {
+    const char* c = static_cast<const char*>(p);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (c >= blocks[i].get() && c < blocks[i].get() + blockSizes[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+GraphArena* GraphArena::current() {
+    return currentArena;
+}
+
+GraphArena* GraphArena::exchange_current(GraphArena* arena) {
+    GraphArena* previous = currentArena;
+    currentArena = arena;
+    return previous;
+}
@@ -0,0 +1,62 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GRAPHARENA_HPP_
+#define GRAPHARENA_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class ExprAST;
+
+/// GraphArena - Expression nodes bump-allocated in large blocks and
+/// destroyed all together with the arena. Nodes in an arena refer to each
+/// other without reference counting; see GraphBuilder. Always owned by a
+/// shared_ptr, which Exprs built in a GraphBuilder::Scope share.
+class GraphArena : public std::enable_shared_from_this<GraphArena> {
+    static const size_t blockSize = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> blockSizes;
+    char* cursor;
+    char* end;
+    std::vector<ExprAST*> nodes;
+
+ public:
+    GraphArena();
+    GraphArena(const GraphArena&) = delete;
+    GraphArena& operator=(const GraphArena&) = delete;
+    ~GraphArena();
+    // Returns uninitialized memory which lives as long as the arena.
+    void* allocate(size_t size, size_t alignment);
+    // Destroy node, constructed in memory from allocate, with the arena.
+    void adopt(ExprAST* node);
+    bool contains(const void* p) const;
+    size_t size() const { return nodes.size(); }
+    // The arena new nodes of this thread go to, or nullptr for the heap.
+    static GraphArena* current();
+    // Makes arena current and returns the previous one.
+    static GraphArena* exchange_current(GraphArena* arena);
+};
+
+#endif  // GRAPHARENA_HPP_
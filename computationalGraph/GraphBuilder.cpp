@@ -0,0 +1,91 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "GraphBuilder.hpp"
+
+GraphBuilder::GraphBuilder() : arena(std::make_shared<GraphArena>()) {
+}
+
+Node GraphBuilder::number(double value) {
+    return Node(make_expr_in<NumberExprAST>(arena.get(), value));
+}
+
+Node GraphBuilder::variable(const Var& var) {
+    if (var.value != nullptr) {
+        return Node(Expr(var.value));
+    }
+    return Node(make_expr_in<VarExprAST>(arena.get(), var.name));
+}
+
+Node GraphBuilder::param(const Param& param) {
+    return Node(make_expr_in<ParamExprAST>(arena.get(), param.name, param.value));
+}
+
+Node GraphBuilder::add(Node lhs, Node rhs) {
+    return Node(make_expr_in<BinaryExprAST>(arena.get(), '+', std::move(lhs.expr), std::move(rhs.expr)));
+}
+
+Node GraphBuilder::multiply(Node lhs, Node rhs) {
+    return Node(make_expr_in<BinaryExprAST>(arena.get(), '*', std::move(lhs.expr), std::move(rhs.expr)));
+}
+
+Node GraphBuilder::divide(Node lhs, Node rhs) {
+    return Node(make_expr_in<BinaryExprAST>(arena.get(), '/', std::move(lhs.expr), std::move(rhs.expr)));
+}
+
+Node GraphBuilder::sin(Node a) {
+    return Node(make_expr_in<Sin>(arena.get(), std::move(a.expr)));
+}
+
+Node GraphBuilder::pow(Node a, Node b) {
+    return Node(make_expr_in<Pow>(arena.get(), std::move(a.expr), std::move(b.expr)));
+}
+
+Node GraphBuilder::reuse(const Node& node) const {
+    return Node(node.expr);
+}
+
+Node GraphBuilder::import(Expr expr) const {
+    // An Expr built in a Scope of this builder owns the arena.
+    return Node(arena_operand(arena, std::move(expr)));
+}
+
+Expr GraphBuilder::finish(Node root) const {
+    return finish(root.expr);
+}
+
+Expr GraphBuilder::finish(const Expr& root) const {
+    if (root.value == nullptr || !arena->contains(root.value.get())) {
+        // Already owned by someone else.
+        return root;
+    }
+    return Expr(std::shared_ptr<ExprAST>(arena, root.value.get()));
+}
+
+GraphBuilder::Scope::Scope(GraphBuilder& builder) {
+    previous = GraphArena::exchange_current(builder.arena.get());
+}
+
+GraphBuilder::Scope::~Scope() {
+    GraphArena::exchange_current(previous);
+}
@@ -0,0 +1,96 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GRAPHBUILDER_HPP_
+#define GRAPHBUILDER_HPP_
+
+#include <memory>
+
+#include "Expr.hpp"
+#include "ExprAST.hpp"
+#include "GraphArena.hpp"
+#include "Param.hpp"
+#include "Var.hpp"
+
+/// Node - Move-only handle to a node of a GraphBuilder. Handing a node to
+/// an operation consumes the handle; use GraphBuilder::reuse to refer to
+/// the same node more than once.
+class Node {
+    Expr expr;
+    explicit Node(Expr expr) : expr(std::move(expr)) {}
+    friend class GraphBuilder;
+
+ public:
+    Node(Node&&) = default;
+    Node& operator=(Node&&) = default;
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+};
+
+/// GraphBuilder - Builds expressions in a GraphArena, for graphs with
+/// millions of nodes: nodes cost a bump allocation, and handles neither
+/// allocate nor touch reference counts.
+///
+///   GraphBuilder builder;
+///   Node sum = builder.number(0);
+///   for (...) sum = builder.add(std::move(sum), builder.variable(x));
+///   f(x) = builder.finish(std::move(sum));
+///
+/// While a GraphBuilder::Scope is alive, the Expr operators, F::sin and
+/// F::pow on its thread put their nodes in the arena too, and the Exprs
+/// they return keep the arena alive like the one returned by finish. The
+/// Node handles don't, and must not outlive the builder.
+class GraphBuilder {
+    std::shared_ptr<GraphArena> arena;
+
+ public:
+    GraphBuilder();
+    Node number(double value);
+    Node variable(const Var& var);
+    Node param(const Param& param);
+    Node add(Node lhs, Node rhs);
+    Node multiply(Node lhs, Node rhs);
+    Node divide(Node lhs, Node rhs);
+    Node sin(Node a);
+    Node pow(Node a, Node b);
+    // Another handle to the node of node, for graphs which share subexpressions.
+    Node reuse(const Node& node) const;
+    // Use an existing expression, which is not copied, as a node.
+    Node import(Expr expr) const;
+    // Returns root as an Expr which keeps the whole arena alive.
+    Expr finish(Node root) const;
+    Expr finish(const Expr& root) const;
+    size_t size() const { return arena->size(); }
+
+    /// Scope - Makes the Expr API build in the arena of a GraphBuilder.
+    class Scope {
+        GraphArena* previous;
+     public:
+        explicit Scope(GraphBuilder& builder);
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope();
+    };
+};
+
+#endif  // GRAPHBUILDER_HPP_
@@ -20,14 +20,19 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <cmath>
+#include <cstdint>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <functional>
+#include <utility>
 
 #include "IRVisitor.hpp"
-#include "ExprAST.hpp"
+#include "MathLibrary.hpp"
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/BasicBlock.h"
@@ -35,11 +40,17 @@
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/ExecutionEngine/MCJIT.h"
@@ -49,22 +60,101 @@
 #include "Var.hpp"
 #include "Func.hpp"
 
-static llvm::LLVMContext TheContext;
+static std::once_flag targetInitialized;
 
-IRVisitor::IRVisitor() {
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
-    builder = new llvm::IRBuilder<>(TheContext);
-    module = llvm::make_unique<llvm::Module>("abc", TheContext);
+// Every visitor generates code in an LLVMContext of its own, so that any
+// number of them can be used on different threads at once.
+IRVisitor::IRVisitor() : threadSafeContext(llvm::make_unique<llvm::LLVMContext>()) {
+    std::call_once(targetInitialized, []() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+    });
+    builder = new llvm::IRBuilder<>(*context());
+    module = llvm::make_unique<llvm::Module>("abc", *context());
 }
 
 llvm::LLVMContext* IRVisitor::context() {
-    return &TheContext;
+    return threadSafeContext.getContext();
 }
 
-llvm::Value* IRVisitor::visit(Expr exp) {
-    std::cout << "Visit" << std::endl;
-    return exp.accept(this);
+// Hand the module over together with its context, e.g. to JIT::add.
+llvm::orc::ThreadSafeModule IRVisitor::release_module() {
+    return llvm::orc::ThreadSafeModule(std::move(module), threadSafeContext);
+}
+
+// Emit every node of graph in one forward scan, which reaches the operands
+// of a node before the node.
+void IRVisitor::emit(const Graph &graph) {
+    nodeValues.assign(graph.size(), nullptr);
+    for (size_t i = 0; i < graph.size(); i++) {
+        const Graph::Node &node = graph[i];
+        switch (node.opcode) {
+        case Graph::Argument:
+            nodeValues[i] = argumentValues[node.a];
+            break;
+        case Graph::Parameter:
+            nodeValues[i] = create_param(graph.parameter_name(node.a), graph.parameter_value(node.a));
+            break;
+        case Graph::Constant:
+            nodeValues[i] = createValue(node.constant);
+            break;
+        case Graph::Add:
+            nodeValues[i] = create_binary('+', nodeValues[node.a], nodeValues[node.b]);
+            break;
+        case Graph::Multiply:
+            nodeValues[i] = create_binary('*', nodeValues[node.a], nodeValues[node.b]);
+            break;
+        case Graph::Divide:
+            nodeValues[i] = create_binary('/', nodeValues[node.a], nodeValues[node.b]);
+            break;
+        case Graph::Sine:
+            nodeValues[i] = create_math_call("sin", {nodeValues[node.a]});
+            break;
+        case Graph::Power:
+            nodeValues[i] = create_power(nodeValues[node.a], nodeValues[node.b]);
+            break;
+        }
+    }
+}
+
+// Forget every emitted value. This has to be called whenever the graph is
+// emitted again into another function or with another width.
+void IRVisitor::clear_values() {
+    argumentValues.clear();
+    nodeValues.clear();
+    operation2Value.clear();
+}
+
+// Set the fast-math flags of every floating point operation emitted from
+// now on. Call it before emitting a function, since values already emitted
+// are reused whatever flags they have.
+void IRVisitor::set_math_policy(MathPolicy policy) {
+    mathPolicy = policy;
+    llvm::FastMathFlags flags;
+    switch (policy) {
+    case Fast:
+        flags.setFast();
+        break;
+    case Reassociate:
+        flags.setAllowReassoc();
+        flags.setAllowReciprocal();
+        flags.setAllowContract(true);
+        break;
+    case Contract:
+        flags.setAllowContract(true);
+        break;
+    default:
+        break;
+    }
+    builder->setFastMathFlags(flags);
+}
+
+size_t IRVisitor::OperationHash::operator()(const Operation &operation) const {
+    size_t hash = std::hash<std::string>()(operation.first);
+    for (auto value : operation.second) {
+        hash = hash * 31 + std::hash<llvm::Value*>()(value);
+    }
+    return hash;
 }
 
 IRVisitor::~IRVisitor() {
@@ -72,18 +162,80 @@ IRVisitor::~IRVisitor() {
 }
 
 llvm::Value* IRVisitor::createValue(double value) {
-    return llvm::ConstantFP::get(TheContext, llvm::APFloat(value));
+    llvm::Constant *constant = llvm::ConstantFP::get(*context(), llvm::APFloat(value));
+    if (width > 1) {
+        return builder->CreateVectorSplat(width, constant);
+    }
+    return constant;
+}
+
+// The global a Param is stored in, whose address is looked up to set it.
+std::string IRVisitor::param_symbol(const std::string &name) {
+    return "param_" + name;
+}
+
+// The names of the Params the module reads.
+std::vector<std::string> IRVisitor::params() const {
+    std::vector<std::string> names;
+    std::string prefix = param_symbol("");
+    for (auto &global : module->globals()) {
+        std::string symbol = global.getName().str();
+        if (symbol.compare(0, prefix.size(), prefix) == 0) {
+            names.push_back(symbol.substr(prefix.size()));
+        }
+    }
+    return names;
+}
+
+// The global a Param is kept in. Each is a global of the module, which
+// starts out with the value the Param was created with.
+static llvm::GlobalVariable* param_global(llvm::Module *module, const std::string &name, double value) {
+    llvm::Type *doubleType = llvm::Type::getDoubleTy(module->getContext());
+    llvm::GlobalVariable *global = module->getGlobalVariable(IRVisitor::param_symbol(name));
+    if (global == nullptr) {
+        global = new llvm::GlobalVariable(*module, doubleType, false, llvm::GlobalValue::ExternalLinkage,
+                                          llvm::ConstantFP::get(doubleType, value), IRVisitor::param_symbol(name));
+        global->setAlignment(sizeof(double));
+    }
+    return global;
+}
+
+// Load the current value of a Param, or take the one load_params loaded.
+llvm::Value* IRVisitor::create_param(const std::string &name, double value) {
+    llvm::Value *loaded;
+    auto found = paramLoads.find(name);
+    if (found != paramLoads.end()) {
+        loaded = found->second;
+    } else {
+        loaded = builder->CreateLoad(llvm::Type::getDoubleTy(*context()), param_global(module.get(), name, value), name);
+    }
+    if (width > 1) {
+        return builder->CreateVectorSplat(width, loaded);
+    }
+    return loaded;
+}
+
+// Load every Param of graph at the current insert point, the entry block of
+// a row kernel, for create_param to use in its loops. create_rows forgets
+// them once the kernel is done.
+void IRVisitor::load_params(const Graph &graph) {
+    paramLoads.clear();
+    for (size_t slot = 0; slot < graph.parameters(); slot++) {
+        const std::string &name = graph.parameter_name(slot);
+        llvm::GlobalVariable *global = param_global(module.get(), name, graph.parameter_value(slot));
+        paramLoads[name] = builder->CreateLoad(llvm::Type::getDoubleTy(*context()), global, name);
+    }
 }
 
-llvm::Function* IRVisitor::create_callee(const std::vector<Var> &argumentPlacefolders, std::string name, Expr expr) {
+llvm::Function* IRVisitor::create_callee(const std::vector<Var> &argumentPlacefolders, std::string name, const Graph &graph) {
     using llvm::Function;
     using llvm::FunctionType;
     using llvm::BasicBlock;
     using llvm::Type;
 
     // arguments double to ptr
-    std::vector<llvm::Type *> Doubles(argumentPlacefolders.size(), Type::getDoubleTy(TheContext));
-    FunctionType *funcType = llvm::FunctionType::get(Type::getDoubleTy(TheContext), Doubles, false);
+    std::vector<llvm::Type *> Doubles(argumentPlacefolders.size(), Type::getDoubleTy(*context()));
+    FunctionType *funcType = llvm::FunctionType::get(Type::getDoubleTy(*context()), Doubles, false);
 
     llvm::Function *callee = Function::Create(funcType, Function::ExternalLinkage, name, module.get());
 
@@ -93,19 +245,18 @@ llvm::Function* IRVisitor::create_callee(const std::vector<Var> &argumentPlacefo
         arg.setName(argumentPlacefolders[idx++].name);
     }
 
-    // Record the function arguments in the NamedValues map.
-    name2Value.clear();
+    clear_values();
     for (auto &arg : callee->args()) {
-        name2Value[std::string(arg.getName())] = &arg;
+        argumentValues.push_back(&arg);
     }
 
     // Create a new basic block to start insertion into.
-    llvm::BasicBlock *basicBlock = llvm::BasicBlock::Create(TheContext, "entry", callee);
+    llvm::BasicBlock *basicBlock = llvm::BasicBlock::Create(*context(), "entry", callee);
     builder->SetInsertPoint(basicBlock);
 
-    llvm::Value *RetVal = this->visit(expr);
+    this->emit(graph);
 
-    builder->CreateRet(RetVal);
+    builder->CreateRet(nodeValues[graph.outputs().front()]);
 
     // varify LLVM IR
     if (verifyFunction(*callee, &llvm::errs())) {
@@ -115,62 +266,866 @@ llvm::Function* IRVisitor::create_callee(const std::vector<Var> &argumentPlacefo
     return callee;
 }
 
-llvm::Function *IRVisitor::create_caller(llvm::Function *callee, const std::vector<double> &arguments, std::string name) {
+// Emit a reentrant entry point for a single point.
+//
+// void caller(const double *arguments, double *out) {
+//     out[0] = callee(arguments[0], arguments[1], ...);
+// }
+//
+// Everything it reads comes in through its parameters, so one compiled
+// function can be called from any number of threads at once.
+llvm::Function *IRVisitor::create_caller(llvm::Function *callee, std::string name) {
     using llvm::Function;
     using llvm::FunctionType;
-    using llvm::BasicBlock;
     using llvm::Type;
 
-    // define function
-    // argument name list
-    auto functionName = "caller";
-    // argument type list
-    std::vector<Type *> vacant = {Type::getDoubleTy(TheContext)};
-    // create function type
-    FunctionType *functionType = FunctionType::get(Type::getDoubleTy(TheContext), vacant, false);
-    // create function in the module.
-    Function *caller = Function::Create(functionType, Function::ExternalLinkage, functionName, module.get());
+    Type *doubleType = Type::getDoubleTy(*context());
+    Type *doublePtrType = llvm::PointerType::getUnqual(doubleType);
+    std::vector<Type *> parameters = {doublePtrType, doublePtrType};
+    FunctionType *functionType = FunctionType::get(Type::getVoidTy(*context()), parameters, false);
+    Function *caller = Function::Create(functionType, Function::ExternalLinkage, name, module.get());
 
-    // Create a new basic block to start insertion into.
-    BasicBlock *basicBlock = BasicBlock::Create(TheContext, "entry", caller);
+    auto it = caller->arg_begin();
+    llvm::Value *arguments = &*it++;
+    llvm::Value *out = &*it++;
+    arguments->setName("arguments");
+    out->setName("out");
+
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context(), "entry", caller));
+
+    std::vector<llvm::Value *> argumentValues;
+    for (unsigned i = 0; i < callee->arg_size(); i++) {
+        llvm::Value *address = builder->CreateConstInBoundsGEP1_64(doubleType, arguments, i);
+        argumentValues.push_back(builder->CreateLoad(doubleType, address, "argument"));
+    }
+    builder->CreateStore(builder->CreateCall(callee, argumentValues, "result"), out);
+    builder->CreateRetVoid();
+
+    // varify LLVM IR
+    if (verifyFunction(*caller, &llvm::errs())) {
+        throw 1;
+    }
+
+    return caller;
+}
 
-    static llvm::IRBuilder<> builder(TheContext);
+// Emit a single point entry point which takes the callee specialized on the
+// values it is called with, if there is one.
+//
+// void caller(const double *arguments, double *out) {
+//     if (bits(arguments[i]) == bits(value_i) && ...)
+//         out[0] = special0(arguments[j], ...);
+//     else if (...)
+//         ...
+//     else
+//         out[0] = callee(arguments[0], arguments[1], ...);
+// }
+//
+// Values are compared by their bits, so that a guard never passes for a
+// value which only compares equal, like -0 for 0.
+llvm::Function *IRVisitor::create_guarded_caller(llvm::Function *callee, const std::vector<GuardedCallee> &guarded, std::string name) {
+    using llvm::Function;
+    using llvm::FunctionType;
+    using llvm::Type;
 
-    builder.SetInsertPoint(basicBlock);
+    Type *doubleType = Type::getDoubleTy(*context());
+    Type *int64Type = Type::getInt64Ty(*context());
+    Type *doublePtrType = llvm::PointerType::getUnqual(doubleType);
+    std::vector<Type *> parameters = {doublePtrType, doublePtrType};
+    FunctionType *functionType = FunctionType::get(Type::getVoidTy(*context()), parameters, false);
+    Function *caller = Function::Create(functionType, Function::ExternalLinkage, name, module.get());
 
-    // LLVM IR builder
-    std::vector<llvm::Value *> arguments_values = {};
+    auto it = caller->arg_begin();
+    llvm::Value *arguments = &*it++;
+    llvm::Value *out = &*it++;
+    arguments->setName("arguments");
+    out->setName("out");
 
-    for (int i = 0; i < arguments.size(); i++) {
-        u_int64_t p = (u_int64_t)&arguments[i];
-        llvm::Constant *constant = llvm::ConstantPointerNull::getIntegerValue(llvm::PointerType::getDoublePtrTy(TheContext), llvm::APInt(64, 1, &p));
-        auto temp = builder.CreateLoad(constant, "buf");
-        arguments_values.push_back(temp);
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context(), "entry", caller));
+
+    // Every argument is loaded once, up front.
+    std::vector<llvm::Value *> argumentValues;
+    for (unsigned i = 0; i < callee->arg_size(); i++) {
+        llvm::Value *address = builder->CreateConstInBoundsGEP1_64(doubleType, arguments, i);
+        argumentValues.push_back(builder->CreateLoad(doubleType, address, "argument"));
     }
 
-    llvm::ArrayRef<llvm::Value*> a(arguments_values);
+    for (auto &special : guarded) {
+        llvm::Value *matches = llvm::ConstantInt::getTrue(*context());
+        for (auto &bound : special.bound) {
+            llvm::Value *bits = builder->CreateBitCast(argumentValues[bound.first], int64Type, "bits");
+            llvm::Value *expected = llvm::ConstantInt::get(int64Type, llvm::APFloat(bound.second).bitcastToAPInt());
+            matches = builder->CreateAnd(matches, builder->CreateICmpEQ(bits, expected), "guard");
+        }
+        llvm::BasicBlock *fast = llvm::BasicBlock::Create(*context(), "specialized", caller);
+        llvm::BasicBlock *next = llvm::BasicBlock::Create(*context(), "next", caller);
+        builder->CreateCondBr(matches, fast, next);
 
-    auto result = builder.CreateCall(callee, a, "a");
+        builder->SetInsertPoint(fast);
+        std::vector<llvm::Value *> remainingValues;
+        for (int index : special.remaining) {
+            remainingValues.push_back(argumentValues[index]);
+        }
+        builder->CreateStore(builder->CreateCall(special.callee, remainingValues, "result"), out);
+        builder->CreateRetVoid();
 
-    builder.CreateRet(result);
+        builder->SetInsertPoint(next);
+    }
+    builder->CreateStore(builder->CreateCall(callee, argumentValues, "result"), out);
+    builder->CreateRetVoid();
 
     // varify LLVM IR
     if (verifyFunction(*caller, &llvm::errs())) {
         throw 1;
     }
 
-    // confirm LLVM IR
-    module->print(llvm::outs(), nullptr);
+    return caller;
+}
 
-    // confirm the current module status
-    if (verifyModule(*module, &llvm::errs())) {
+// Emit a reentrant entry point which runs a gradient kernel for a single point.
+//
+// void caller(const double *arguments, double *out) {
+//     double *columns[] = {&arguments[0], &arguments[1], ...};
+//     double *outputs[] = {&out[0], &out[1], ...};
+//     gradient(columns, 1, outputs);
+// }
+//
+// The pointer tables live in the caller's stack frame, so that concurrent
+// calls share nothing.
+llvm::Function *IRVisitor::create_gradient_caller(llvm::Function *gradient, unsigned arguments, std::string name) {
+    using llvm::Function;
+    using llvm::FunctionType;
+    using llvm::Type;
+
+    Type *doubleType = Type::getDoubleTy(*context());
+    Type *doublePtrType = llvm::PointerType::getUnqual(doubleType);
+    std::vector<Type *> parameters = {doublePtrType, doublePtrType};
+    FunctionType *functionType = FunctionType::get(Type::getVoidTy(*context()), parameters, false);
+    Function *caller = Function::Create(functionType, Function::ExternalLinkage, name, module.get());
+
+    auto it = caller->arg_begin();
+    llvm::Value *point = &*it++;
+    llvm::Value *out = &*it++;
+    point->setName("arguments");
+    out->setName("out");
+
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context(), "entry", caller));
+
+    // Fill a table of pointers to count consecutive doubles starting at base.
+    auto createTable = [&](llvm::Value *base, unsigned count, const std::string &tableName) {
+        llvm::ArrayType *tableType = llvm::ArrayType::get(doublePtrType, count);
+        llvm::Value *table = builder->CreateAlloca(tableType, nullptr, tableName);
+        for (unsigned i = 0; i < count; i++) {
+            llvm::Value *element = builder->CreateConstInBoundsGEP1_64(doubleType, base, i);
+            builder->CreateStore(element, builder->CreateConstInBoundsGEP2_64(tableType, table, 0, i));
+        }
+        return builder->CreateConstInBoundsGEP2_64(tableType, table, 0, 0);
+    };
+    llvm::Value *columns = createTable(point, arguments, "columns");
+    llvm::Value *outputs = createTable(out, arguments + 1, "outputs");
+
+    llvm::Value *rows = llvm::ConstantInt::get(Type::getInt64Ty(*context()), 1);
+    builder->CreateCall(gradient, {columns, rows, outputs});
+    builder->CreateRetVoid();
+
+    // varify LLVM IR
+    if (verifyFunction(*caller, &llvm::errs())) {
         throw 1;
     }
 
     return caller;
 }
 
-llvm::ExecutionEngine *IRVisitor::create_engine() {
-    llvm::EngineBuilder builder(std::move(module));
-    return builder.create();
+// Emit a kernel which evaluates graph for every row of structure-of-arrays input.
+//
+// void batch(double **columns, i64 rows, double *out) {
+//     for (i64 i = 0; i < rows; i++)
+//         out[i] = graph(columns[0][i], columns[1][i], ...);
+// }
+//
+// The graph is emitted directly into the loop bodies instead of calling
+// callee, so that the whole row computation is visible to LLVM at once.
+llvm::Function* IRVisitor::create_batch(const std::vector<Var> &argumentPlacefolders, std::string name, const Graph &graph, unsigned width) {
+    using llvm::Function;
+    using llvm::FunctionType;
+    using llvm::Type;
+
+    Type *doublePtrType = llvm::PointerType::getUnqual(Type::getDoubleTy(*context()));
+    std::vector<Type *> parameters = {llvm::PointerType::getUnqual(doublePtrType), Type::getInt64Ty(*context()), doublePtrType};
+    FunctionType *functionType = FunctionType::get(Type::getVoidTy(*context()), parameters, false);
+    Function *batch = Function::Create(functionType, Function::ExternalLinkage, name, module.get());
+
+    auto it = batch->arg_begin();
+    llvm::Value *columns = &*it++;
+    llvm::Value *rows = &*it++;
+    llvm::Value *out = &*it++;
+    columns->setName("columns");
+    rows->setName("rows");
+    out->setName("out");
+
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context(), "entry", batch));
+    load_params(graph);
+    create_rows(argumentPlacefolders, columns, rows, {out}, width, [&]() {
+        this->emit(graph);
+        return std::vector<llvm::Value *>{nodeValues[graph.outputs().front()]};
+    });
+
+    // varify LLVM IR
+    if (verifyFunction(*batch, &llvm::errs())) {
+        throw 1;
+    }
+
+    return batch;
+}
+
+// Emit a kernel which evaluates graph and its gradient for every row.
+//
+// void gradient(double **columns, i64 rows, double **out) {
+//     for (i64 i = 0; i < rows; i++) {
+//         out[0][i] = graph(columns[0][i], ...);
+//         out[1 + k][i] = d graph / d argument k;
+//     }
+// }
+llvm::Function* IRVisitor::create_gradient(const std::vector<Var> &argumentPlacefolders, std::string name, const Graph &graph, unsigned width) {
+    using llvm::Function;
+    using llvm::FunctionType;
+    using llvm::Type;
+
+    Type *doublePtrType = llvm::PointerType::getUnqual(Type::getDoubleTy(*context()));
+    Type *columnsType = llvm::PointerType::getUnqual(doublePtrType);
+    std::vector<Type *> parameters = {columnsType, Type::getInt64Ty(*context()), columnsType};
+    FunctionType *functionType = FunctionType::get(Type::getVoidTy(*context()), parameters, false);
+    Function *gradient = Function::Create(functionType, Function::ExternalLinkage, name, module.get());
+
+    auto it = gradient->arg_begin();
+    llvm::Value *columns = &*it++;
+    llvm::Value *rows = &*it++;
+    llvm::Value *out = &*it++;
+    columns->setName("columns");
+    rows->setName("rows");
+    out->setName("out");
+
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context(), "entry", gradient));
+    std::vector<llvm::Value *> outputs;
+    for (size_t i = 0; i < argumentPlacefolders.size() + 1; i++) {
+        llvm::Value *slot = builder->CreateInBoundsGEP(doublePtrType, out, builder->getInt64(i), "outcolptr");
+        outputs.push_back(builder->CreateLoad(doublePtrType, slot, "outcol"));
+    }
+    load_params(graph);
+    create_rows(argumentPlacefolders, columns, rows, outputs, width, [&]() {
+        return this->create_adjoints(graph);
+    });
+
+    // varify LLVM IR
+    if (verifyFunction(*gradient, &llvm::errs())) {
+        throw 1;
+    }
+
+    return gradient;
+}
+
+// Emit a kernel which evaluates the outputs of graph and the non-zero
+// entries of their Jacobian for every row, using forward-mode AD.
+//
+// void jacobian(double **columns, i64 rows, double **out) {
+//     for (i64 i = 0; i < rows; i++) {
+//         out[j][i] = outputs[j](columns[0][i], ...);
+//         out[outputs + e][i] = d outputs[sparsity[e].first] / d argument sparsity[e].second;
+//     }
+// }
+//
+// The tangents are emitted once per argument, with structural zeros
+// skipped, and only the entries listed in sparsity are stored.
+llvm::Function* IRVisitor::create_jacobian(const std::vector<Var> &argumentPlacefolders, std::string name, const Graph &graph,
+                                           const std::vector<std::pair<int, int>> &sparsity, unsigned width) {
+    using llvm::Function;
+    using llvm::FunctionType;
+    using llvm::Type;
+
+    Type *doublePtrType = llvm::PointerType::getUnqual(Type::getDoubleTy(*context()));
+    Type *columnsType = llvm::PointerType::getUnqual(doublePtrType);
+    std::vector<Type *> parameters = {columnsType, Type::getInt64Ty(*context()), columnsType};
+    FunctionType *functionType = FunctionType::get(Type::getVoidTy(*context()), parameters, false);
+    Function *jacobian = Function::Create(functionType, Function::ExternalLinkage, name, module.get());
+
+    auto it = jacobian->arg_begin();
+    llvm::Value *columns = &*it++;
+    llvm::Value *rows = &*it++;
+    llvm::Value *out = &*it++;
+    columns->setName("columns");
+    rows->setName("rows");
+    out->setName("out");
+
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context(), "entry", jacobian));
+    const std::vector<int> &outputs = graph.outputs();
+    std::vector<llvm::Value *> outputPointers;
+    for (size_t i = 0; i < outputs.size() + sparsity.size(); i++) {
+        llvm::Value *slot = builder->CreateInBoundsGEP(doublePtrType, out, builder->getInt64(i), "outcolptr");
+        outputPointers.push_back(builder->CreateLoad(doublePtrType, slot, "outcol"));
+    }
+    load_params(graph);
+    create_rows(argumentPlacefolders, columns, rows, outputPointers, width, [&]() {
+        this->emit(graph);
+        std::vector<llvm::Value *> results;
+        for (int output : outputs) {
+            results.push_back(nodeValues[output]);
+        }
+        results.resize(outputs.size() + sparsity.size());
+
+        for (size_t k = 0; k < argumentPlacefolders.size(); k++) {
+            std::vector<int> entries;
+            std::vector<int> differentiated;
+            for (size_t e = 0; e < sparsity.size(); e++) {
+                if (sparsity[e].second == static_cast<int>(k)) {
+                    entries.push_back(e);
+                    differentiated.push_back(outputs[sparsity[e].first]);
+                }
+            }
+            if (entries.empty()) {
+                continue;
+            }
+            std::vector<llvm::Value *> tangents = this->create_tangents(graph, k, differentiated);
+            for (int e : entries) {
+                llvm::Value *value = tangents[outputs[sparsity[e].first]];
+                results[outputs.size() + e] = value != nullptr ? value : createValue(0.0);
+            }
+        }
+        return results;
+    });
+
+    // varify LLVM IR
+    if (verifyFunction(*jacobian, &llvm::errs())) {
+        throw 1;
+    }
+
+    return jacobian;
+}
+
+// Emit the loops of a row kernel, starting at the current insert point.
+// body emits the values of one row, with the arguments in argumentValues,
+// and they are stored to outputs[k][i].
+//
+//     i64 i = 0;
+//     for (; i + width <= rows; i += width)      // <width x double> lanes
+//         outputs[k][i:i+width] = body(columns[0][i:i+width], ...);
+//     for (; i < rows; i++)                      // scalar remainder
+//         outputs[k][i] = body(columns[0][i], columns[1][i], ...);
+//
+// When width is 1 only the scalar loop is emitted.
+void IRVisitor::create_rows(const std::vector<Var> &argumentPlacefolders, llvm::Value *columns, llvm::Value *rows,
+                            const std::vector<llvm::Value*> &outputs, unsigned width,
+                            std::function<std::vector<llvm::Value*>()> body) {
+    using llvm::BasicBlock;
+    using llvm::Type;
+
+    Type *doubleType = Type::getDoubleTy(*context());
+    Type *doublePtrType = llvm::PointerType::getUnqual(doubleType);
+    Type *int64Type = Type::getInt64Ty(*context());
+
+    BasicBlock *entryBlock = builder->GetInsertBlock();
+    llvm::Function *function = entryBlock->getParent();
+    BasicBlock *vectorLoopBlock = width > 1 ? BasicBlock::Create(*context(), "vector.loop", function) : nullptr;
+    BasicBlock *remainderBlock = BasicBlock::Create(*context(), "remainder", function);
+    BasicBlock *scalarLoopBlock = BasicBlock::Create(*context(), "scalar.loop", function);
+    BasicBlock *exitBlock = BasicBlock::Create(*context(), "exit", function);
+
+    // Load the base pointer of every column once, outside of the loops.
+    std::vector<llvm::Value *> columnPointers;
+    for (size_t i = 0; i < argumentPlacefolders.size(); i++) {
+        llvm::Value *slot = builder->CreateInBoundsGEP(doublePtrType, columns, builder->getInt64(i), "colptr");
+        columnPointers.push_back(builder->CreateLoad(doublePtrType, slot, "col"));
+    }
+    // The number of rows handled by the vector loop, rounded down to width.
+    llvm::Value *vectorRows = builder->getInt64(0);
+    if (width > 1) {
+        vectorRows = builder->CreateSub(rows, builder->CreateSRem(rows, builder->getInt64(width)), "vrows");
+        llvm::Value *hasVector = builder->CreateICmpSGT(vectorRows, builder->getInt64(0), "hasvector");
+        builder->CreateCondBr(hasVector, vectorLoopBlock, remainderBlock);
+    } else {
+        builder->CreateBr(remainderBlock);
+    }
+
+    // Vector loop body, evaluating width rows at once.
+    if (width > 1) {
+        builder->SetInsertPoint(vectorLoopBlock);
+        Type *vectorType = llvm::VectorType::get(doubleType, width);
+        Type *vectorPtrType = llvm::PointerType::getUnqual(vectorType);
+
+        llvm::PHINode *index = builder->CreatePHI(int64Type, 2, "vi");
+        index->addIncoming(builder->getInt64(0), entryBlock);
+
+        this->width = width;
+        clear_values();
+        for (size_t i = 0; i < argumentPlacefolders.size(); i++) {
+            llvm::Value *address = builder->CreateInBoundsGEP(doubleType, columnPointers[i], index, "argptr");
+            address = builder->CreateBitCast(address, vectorPtrType);
+            argumentValues.push_back(builder->CreateAlignedLoad(vectorType, address, sizeof(double), argumentPlacefolders[i].name));
+        }
+
+        std::vector<llvm::Value *> results = body();
+        for (size_t k = 0; k < outputs.size(); k++) {
+            llvm::Value *outAddress = builder->CreateInBoundsGEP(doubleType, outputs[k], index, "outptr");
+            outAddress = builder->CreateBitCast(outAddress, vectorPtrType);
+            builder->CreateAlignedStore(results[k], outAddress, sizeof(double));
+        }
+        this->width = 1;
+
+        llvm::Value *next = builder->CreateAdd(index, builder->getInt64(width), "vnext", true, true);
+        index->addIncoming(next, builder->GetInsertBlock());
+        llvm::Value *isDone = builder->CreateICmpEQ(next, vectorRows, "vdone");
+        builder->CreateCondBr(isDone, remainderBlock, vectorLoopBlock);
+    }
+
+    // Skip the scalar loop when there are no rows left.
+    builder->SetInsertPoint(remainderBlock);
+    llvm::Value *hasRemainder = builder->CreateICmpSLT(vectorRows, rows, "hasremainder");
+    builder->CreateCondBr(hasRemainder, scalarLoopBlock, exitBlock);
+
+    // Scalar loop body, evaluating one row.
+    builder->SetInsertPoint(scalarLoopBlock);
+    llvm::PHINode *index = builder->CreatePHI(int64Type, 2, "i");
+    index->addIncoming(vectorRows, remainderBlock);
+
+    clear_values();
+    for (size_t i = 0; i < argumentPlacefolders.size(); i++) {
+        llvm::Value *address = builder->CreateInBoundsGEP(doubleType, columnPointers[i], index, "argptr");
+        argumentValues.push_back(builder->CreateLoad(doubleType, address, argumentPlacefolders[i].name));
+    }
+
+    std::vector<llvm::Value *> results = body();
+    for (size_t k = 0; k < outputs.size(); k++) {
+        llvm::Value *outAddress = builder->CreateInBoundsGEP(doubleType, outputs[k], index, "outptr");
+        builder->CreateStore(results[k], outAddress);
+    }
+
+    llvm::Value *next = builder->CreateAdd(index, builder->getInt64(1), "next", true, true);
+    index->addIncoming(next, builder->GetInsertBlock());
+    llvm::Value *isDone = builder->CreateICmpEQ(next, rows, "done");
+    builder->CreateCondBr(isDone, exitBlock, scalarLoopBlock);
+
+    builder->SetInsertPoint(exitBlock);
+    builder->CreateRetVoid();
+    paramLoads.clear();
+}
+
+// Emit the output of graph followed by its reverse-mode derivatives.
+// Returns the value and then the partial derivative with respect to each
+// argument.
+//
+// The forward scan of emit is a topological order. Scanning backwards from
+// the output, each node passes its adjoint on to its operands, reusing the
+// forward values. Constant subtrees don't depend on any argument, so their
+// derivatives are not emitted.
+std::vector<llvm::Value*> IRVisitor::create_adjoints(const Graph &graph) {
+    emit(graph);
+    int output = graph.outputs().front();
+
+    std::vector<llvm::Value *> adjoints(graph.size(), nullptr);
+    std::vector<llvm::Value *> argumentAdjoints(graph.arguments(), nullptr);
+    auto needs_adjoint = [&](int operand) {
+        return !llvm::isa<llvm::Constant>(nodeValues[operand]);
+    };
+    auto add_adjoint = [&](int operand, llvm::Value *adjoint) {
+        adjoints[operand] = add_tangents(adjoints[operand], adjoint);
+    };
+
+    adjoints[output] = createValue(1.0);
+    for (int i = output; i >= 0; i--) {
+        llvm::Value *adjoint = adjoints[i];
+        if (adjoint == nullptr) {
+            continue;
+        }
+        const Graph::Node &node = graph[i];
+        switch (node.opcode) {
+        case Graph::Argument:
+            argumentAdjoints[node.a] = add_tangents(argumentAdjoints[node.a], adjoint);
+            break;
+        case Graph::Parameter:
+        case Graph::Constant:
+            // Params are held fixed, like numbers.
+            break;
+        case Graph::Add:
+            // d(l + r) = dl + dr
+            if (needs_adjoint(node.a)) {
+                add_adjoint(node.a, adjoint);
+            }
+            if (needs_adjoint(node.b)) {
+                add_adjoint(node.b, adjoint);
+            }
+            break;
+        case Graph::Multiply:
+            // d(l * r) = r dl + l dr
+            if (needs_adjoint(node.a)) {
+                add_adjoint(node.a, create_binary('*', adjoint, nodeValues[node.b]));
+            }
+            if (needs_adjoint(node.b)) {
+                add_adjoint(node.b, create_binary('*', adjoint, nodeValues[node.a]));
+            }
+            break;
+        case Graph::Divide:
+            // d(l / r) = dl / r - (l / r) dr / r
+            if (needs_adjoint(node.a)) {
+                add_adjoint(node.a, create_binary('/', adjoint, nodeValues[node.b]));
+            }
+            if (needs_adjoint(node.b)) {
+                llvm::Value *scaled = create_binary('/', create_binary('*', adjoint, nodeValues[i]), nodeValues[node.b]);
+                add_adjoint(node.b, create_binary('*', scaled, createValue(-1.0)));
+            }
+            break;
+        case Graph::Sine:
+            // d sin(x) = cos(x) dx
+            if (needs_adjoint(node.a)) {
+                llvm::Value *cosine = create_math_call("cos", {nodeValues[node.a]});
+                add_adjoint(node.a, create_binary('*', adjoint, cosine));
+            }
+            break;
+        case Graph::Power:
+            // d a^b = b a^(b - 1) da + a^b log(a) db
+            if (needs_adjoint(node.a)) {
+                llvm::Value *exponent = create_binary('+', nodeValues[node.b], createValue(-1.0));
+                llvm::Value *power = create_power(nodeValues[node.a], exponent);
+                add_adjoint(node.a, create_binary('*', adjoint, create_binary('*', nodeValues[node.b], power)));
+            }
+            if (needs_adjoint(node.b)) {
+                llvm::Value *logarithm = create_math_call("log", {nodeValues[node.a]});
+                add_adjoint(node.b, create_binary('*', adjoint, create_binary('*', nodeValues[i], logarithm)));
+            }
+            break;
+        }
+    }
+
+    std::vector<llvm::Value *> results = {nodeValues[output]};
+    for (auto adjoint : argumentAdjoints) {
+        results.push_back(adjoint != nullptr ? adjoint : createValue(0.0));
+    }
+    return results;
+}
+
+// Emit the derivatives along the argument slot of the nodes which outputs
+// depend on, after emit(graph). Returns one value per node, which is
+// nullptr for structural zeros and for the nodes which were not needed.
+std::vector<llvm::Value*> IRVisitor::create_tangents(const Graph &graph, int slot, const std::vector<int> &outputs) {
+    std::vector<bool> needed(graph.size(), false);
+    for (int output : outputs) {
+        needed[output] = true;
+    }
+    for (int i = static_cast<int>(graph.size()) - 1; i >= 0; i--) {
+        if (!needed[i]) {
+            continue;
+        }
+        int operands = Graph::arity(graph[i].opcode);
+        if (operands > 0) {
+            needed[graph[i].a] = true;
+        }
+        if (operands > 1) {
+            needed[graph[i].b] = true;
+        }
+    }
+
+    std::vector<llvm::Value *> tangents(graph.size(), nullptr);
+    for (size_t i = 0; i < graph.size(); i++) {
+        if (!needed[i]) {
+            continue;
+        }
+        const Graph::Node &node = graph[i];
+        llvm::Value *left = Graph::arity(node.opcode) > 0 ? tangents[node.a] : nullptr;
+        llvm::Value *right = Graph::arity(node.opcode) > 1 ? tangents[node.b] : nullptr;
+        switch (node.opcode) {
+        case Graph::Argument:
+            tangents[i] = node.a == slot ? createValue(1.0) : nullptr;
+            break;
+        case Graph::Parameter:
+        case Graph::Constant:
+            break;
+        case Graph::Add:
+            // d(l + r) = dl + dr
+            tangents[i] = add_tangents(left, right);
+            break;
+        case Graph::Multiply:
+            // d(l * r) = r dl + l dr
+            tangents[i] = add_tangents(
+                left ? create_binary('*', left, nodeValues[node.b]) : nullptr,
+                right ? create_binary('*', nodeValues[node.a], right) : nullptr);
+            break;
+        case Graph::Divide:
+            // d(l / r) = dl / r - (l / r) dr / r
+            tangents[i] = add_tangents(
+                left ? create_binary('/', left, nodeValues[node.b]) : nullptr,
+                right ? create_binary('*', create_binary('/', create_binary('*', nodeValues[i], right), nodeValues[node.b]),
+                                      createValue(-1.0)) : nullptr);
+            break;
+        case Graph::Sine:
+            // d sin(x) = cos(x) dx
+            if (left != nullptr) {
+                tangents[i] = create_binary('*', create_math_call("cos", {nodeValues[node.a]}), left);
+            }
+            break;
+        case Graph::Power:
+            // d a^b = b a^(b - 1) da + a^b log(a) db
+            if (left != nullptr) {
+                llvm::Value *exponent = create_binary('+', nodeValues[node.b], createValue(-1.0));
+                llvm::Value *power = create_power(nodeValues[node.a], exponent);
+                tangents[i] = create_binary('*', create_binary('*', nodeValues[node.b], power), left);
+            }
+            if (right != nullptr) {
+                llvm::Value *logarithm = create_math_call("log", {nodeValues[node.a]});
+                tangents[i] = add_tangents(tangents[i], create_binary('*', create_binary('*', nodeValues[i], logarithm), right));
+            }
+            break;
+        }
+    }
+    return tangents;
+}
+
+// Sum of two tangents, either of which may be a structural zero.
+llvm::Value* IRVisitor::add_tangents(llvm::Value *left, llvm::Value *right) {
+    if (left == nullptr) {
+        return right;
+    }
+    if (right == nullptr) {
+        return left;
+    }
+    return create_binary('+', left, right);
+}
+
+llvm::Value* IRVisitor::create_binary(char op, llvm::Value *left, llvm::Value *right) {
+    // + and * are commutative, so order the operands of the key to share
+    // a + b and b + a. The emitted operands keep their order, so that the
+    // IR doesn't depend on where the values happen to be allocated.
+    auto key = std::make_pair(std::string(1, op), std::vector<llvm::Value*>{left, right});
+    if ((op == '+' || op == '*') && std::less<llvm::Value*>()(right, left)) {
+        std::swap(key.second[0], key.second[1]);
+    }
+    auto found = operation2Value.find(key);
+    if (found != operation2Value.end()) {
+        return found->second;
+    }
+
+    llvm::Value *value = nullptr;
+    switch (op) {
+    case '+':
+        value = builder->CreateFAdd(left, right, "addtmp");
+        break;
+    case '*':
+        value = builder->CreateFMul(left, right, "multmp");
+        break;
+    case '/':
+        value = builder->CreateFDiv(left, right, "divtmp");
+        break;
+    }
+    operation2Value[key] = value;
+    return value;
+}
+
+// Call the libm function name. With the default Libm math functions this
+// is the LLVM intrinsic, which computes what libm, and so the interpreter,
+// does. Inline opts into the MathLibrary function for the current width,
+// within the math error bound, which computes all lanes at once instead of
+// calling libm for each of them, and which the optimizer can inline since
+// it is in the module.
+llvm::Value* IRVisitor::create_math_call(std::string name, const std::vector<llvm::Value*> &arguments) {
+    static const std::map<std::string, llvm::Intrinsic::ID> name2Intrinsic = {
+        {"sin", llvm::Intrinsic::sin},
+        {"cos", llvm::Intrinsic::cos},
+        {"exp", llvm::Intrinsic::exp},
+        {"log", llvm::Intrinsic::log},
+        {"pow", llvm::Intrinsic::pow},
+    };
+    auto intrinsic = name2Intrinsic.find(name);
+    if (intrinsic == name2Intrinsic.end()) {
+        throw 1;
+    }
+
+    auto key = std::make_pair(name, arguments);
+    auto found = operation2Value.find(key);
+    if (found != operation2Value.end()) {
+        return found->second;
+    }
+
+    llvm::Function *func;
+    if (mathFunctions == Inline) {
+        MathLibrary library(module.get(), mathErrorBound);
+        func = library.function(name, arguments[0]->getType(), width);
+    } else {
+        func = llvm::Intrinsic::getDeclaration(module.get(), intrinsic->second, {arguments[0]->getType()});
+    }
+    llvm::Value *result = builder->CreateCall(func, arguments, name);
+    operation2Value[key] = result;
+    return result;
+}
+
+// The value of a scalar constant, or of a vector constant splatted from one.
+static bool constant_value(llvm::Value *value, double *result) {
+    llvm::Constant *constant = llvm::dyn_cast<llvm::Constant>(value);
+    if (constant != nullptr && constant->getType()->isVectorTy()) {
+        constant = constant->getSplatValue();
+    }
+    llvm::ConstantFP *number = llvm::dyn_cast_or_null<llvm::ConstantFP>(constant);
+    if (number == nullptr) {
+        return false;
+    }
+    *result = number->getValueAPF().convertToDouble();
+    return true;
+}
+
+// pow(base, exponent). An integer exponent n which is known is computed by
+// squaring and multiplying, in at most 2 log2 |n| multiplications, or with
+// llvm.powi when |n| is large. Each multiplication rounds, so below the
+// Reassociate policy this is only done for n = 0, 1 and 2, where the result
+// is exactly pow's.
+llvm::Value* IRVisitor::create_power(llvm::Value *base, llvm::Value *exponent) {
+    // The largest |n| computed by a chain of multiplications.
+    const double chainLimit = 64;
+    double n;
+    if (!constant_value(exponent, &n) || n != std::trunc(n) || std::fabs(n) > INT32_MAX
+        || (mathPolicy < Reassociate && (n < 0 || n > 2))) {
+        return create_math_call("pow", {base, exponent});
+    }
+    if (n == 0) {
+        // pow(x, 0) is 1 for every x, even NaN.
+        return createValue(1.0);
+    }
+
+    if (std::fabs(n) > chainLimit) {
+        auto key = std::make_pair(std::string("powi"), std::vector<llvm::Value*>{base, exponent});
+        auto found = operation2Value.find(key);
+        if (found != operation2Value.end()) {
+            return found->second;
+        }
+        llvm::Function *func = llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::powi, {base->getType()});
+        llvm::Value *power = builder->getInt32(static_cast<int32_t>(n));
+        llvm::Value *result = builder->CreateCall(func, {base, power}, "powi");
+        operation2Value[key] = result;
+        return result;
+    }
+
+    llvm::Value *result = nullptr;
+    llvm::Value *square = base;
+    for (uint64_t m = static_cast<uint64_t>(std::fabs(n)); m > 0; m >>= 1) {
+        if (m & 1) {
+            result = result == nullptr ? square : create_binary('*', result, square);
+        }
+        if (m > 1) {
+            square = create_binary('*', square, square);
+        }
+    }
+    if (n < 0) {
+        result = create_binary('/', createValue(1.0), result);
+    }
+    return result;
+}
+
+// Choose the number of double lanes from the host CPU features.
+unsigned IRVisitor::host_vector_width() {
+    llvm::StringMap<bool> features;
+    if (!llvm::sys::getHostCPUFeatures(features)) {
+        return 1;
+    }
+    if (features.lookup("avx512f")) {
+        return 8;
+    }
+    if (features.lookup("avx2") || features.lookup("avx")) {
+        return 4;
+    }
+    if (features.lookup("sse2") || features.lookup("neon")) {
+        return 2;
+    }
+    return 1;
+}
+
+// Generate code for the host CPU, so that vector kernels use its registers.
+static void select_host_target(llvm::EngineBuilder *builder) {
+    llvm::StringMap<bool> features;
+    std::vector<std::string> attributes;
+    if (llvm::sys::getHostCPUFeatures(features)) {
+        for (auto &feature : features) {
+            attributes.push_back((feature.getValue() ? "+" : "-") + feature.getKey().str());
+        }
+    }
+    builder->setMCPU(llvm::sys::getHostCPUName());
+    builder->setMAttrs(attributes);
+}
+
+// Run the default new pass manager pipeline of the given level (0-3) on the
+// module. It includes inlining, instcombine, reassociate, GVN and, from O2,
+// the loop and SLP vectorizers.
+void IRVisitor::optimize(unsigned level) {
+    if (level == 0) {
+        return;
+    }
+
+    llvm::EngineBuilder engineBuilder;
+    select_host_target(&engineBuilder);
+    std::unique_ptr<llvm::TargetMachine> targetMachine(engineBuilder.selectTarget());
+    module->setDataLayout(targetMachine->createDataLayout());
+    module->setTargetTriple(targetMachine->getTargetTriple().str());
+
+    llvm::PipelineTuningOptions options;
+    options.LoopVectorization = level >= 2;
+    options.SLPVectorization = level >= 2;
+    llvm::PassBuilder passBuilder(targetMachine.get(), options);
+
+    llvm::LoopAnalysisManager loopAnalysisManager;
+    llvm::FunctionAnalysisManager functionAnalysisManager;
+    llvm::CGSCCAnalysisManager cgsccAnalysisManager;
+    llvm::ModuleAnalysisManager moduleAnalysisManager;
+    passBuilder.registerModuleAnalyses(moduleAnalysisManager);
+    passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
+    passBuilder.registerFunctionAnalyses(functionAnalysisManager);
+    passBuilder.registerLoopAnalyses(loopAnalysisManager);
+    passBuilder.crossRegisterProxies(loopAnalysisManager, functionAnalysisManager, cgsccAnalysisManager, moduleAnalysisManager);
+
+    auto optimizationLevel = llvm::PassBuilder::OptimizationLevel::O1;
+    if (level == 2) {
+        optimizationLevel = llvm::PassBuilder::OptimizationLevel::O2;
+    } else if (level >= 3) {
+        optimizationLevel = llvm::PassBuilder::OptimizationLevel::O3;
+    }
+    llvm::ModulePassManager modulePassManager = passBuilder.buildPerModuleDefaultPipeline(optimizationLevel);
+    modulePassManager.run(*module, moduleAnalysisManager);
+
+    // confirm the current module status
+    if (verifyModule(*module, &llvm::errs())) {
+        throw 1;
+    }
+}
+
+// Compile the module ahead of time into a relocatable object for cpu with
+// the comma separated features, which can be linked into another binary.
+// The cpu "host" takes the name and the features of the machine compiling.
+void IRVisitor::create_object(llvm::SmallVectorImpl<char> *object, unsigned level,
+                              std::string cpu, std::string features) {
+    std::string triple = llvm::sys::getProcessTriple();
+    std::string error;
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (target == nullptr) {
+        llvm::errs() << error << "\n";
+        throw 1;
+    }
+
+    if (cpu == "host") {
+        cpu = llvm::sys::getHostCPUName().str();
+        llvm::StringMap<bool> hostFeatures;
+        llvm::SubtargetFeatures attributes;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+            for (auto &feature : hostFeatures) {
+                attributes.AddFeature(feature.getKey(), feature.getValue());
+            }
+        }
+        features = attributes.getString();
+    }
+    llvm::CodeGenOpt::Level codeGenLevel = level == 0 ? llvm::CodeGenOpt::None : llvm::CodeGenOpt::Default;
+    std::unique_ptr<llvm::TargetMachine> targetMachine(target->createTargetMachine(
+        triple, cpu, features, llvm::TargetOptions(),
+        llvm::Reloc::PIC_, llvm::None, codeGenLevel));
+    module->setDataLayout(targetMachine->createDataLayout());
+    module->setTargetTriple(triple);
+
+    llvm::raw_svector_ostream stream(*object);
+    llvm::legacy::PassManager passManager;
+    if (targetMachine->addPassesToEmitFile(passManager, stream, nullptr, llvm::TargetMachine::CGFT_ObjectFile)) {
+        llvm::errs() << "the target can't emit an object file\n";
+        throw 1;
+    }
+    passManager.run(*module);
 }
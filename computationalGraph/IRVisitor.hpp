@@ -23,9 +23,11 @@
 #ifndef IRVISITOR_HPP_
 #define IRVISITOR_HPP_
 
+#include <functional>
 #include <memory>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <utility>
@@ -38,26 +40,108 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/ExecutionEngine/MCJIT.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+
+#include "Graph.hpp"
 
 class Execution;
-struct Expr;
 class Var;
 class Func;
 
+/// GuardedCallee - A callee specialized on the values of some arguments,
+/// for create_guarded_caller. bound holds the (argument index, value) pairs
+/// and remaining the indices of the arguments it takes, in order.
+struct GuardedCallee {
+    llvm::Function *callee;
+    std::vector<std::pair<int, double>> bound;
+    std::vector<int> remaining;
+};
+
 class IRVisitor {
  public:
+    /// MathPolicy - How far generated code may depart from rounding every
+    /// operation as written, in the order written.
+    ///
+    ///   Strict       IEEE semantics, which the interpreter computes as well
+    ///                as long as the math functions are Libm's.
+    ///   Contract     a * b + c may be fused into an FMA, which rounds once.
+    ///   Reassociate  also reorders sums and products, e.g. to vectorize
+    ///                them, computes x / c as x * (1 / c), and pow(x, n)
+    ///                of an integer constant n by multiplying.
+    ///   Fast         also assumes there is no NaN, infinity or signed zero,
+    ///                and allows approximate math functions.
+    enum MathPolicy { Strict, Contract, Reassociate, Fast };
+
+    /// MathFunctions - What sin, cos, exp, log and pow call.
+    ///
+    ///   Libm         the LLVM intrinsics, which call libm once per lane and
+    ///                compute what the interpreter does.
+    ///   Inline       the MathLibrary functions, emitted into the module,
+    ///                which compute all lanes at once within the math error
+    ///                bound.
+    enum MathFunctions { Libm, Inline };
+
     llvm::IRBuilder<> *builder;
-    std::map<std::string, llvm::Value*> name2Value;
+    // Values of the arguments, and of the nodes of the Graph last emitted.
+    std::vector<llvm::Value*> argumentValues;
+    std::vector<llvm::Value*> nodeValues;
+    // Values keyed by operation and operand values, so that values which
+    // derivatives compute again are emitted once. Hashed, so that emitting
+    // a graph takes time linear in its size.
+    typedef std::pair<std::string, std::vector<llvm::Value*>> Operation;
+    struct OperationHash {
+        size_t operator()(const Operation &operation) const;
+    };
+    std::unordered_map<Operation, llvm::Value*, OperationHash> operation2Value;
+    // The Params of the row kernel being emitted, loaded once in its entry
+    // block instead of in every iteration of its loops.
+    std::map<std::string, llvm::Value*> paramLoads;
+    // Declared before module, which has to be destroyed first.
+    llvm::orc::ThreadSafeContext threadSafeContext;
     std::unique_ptr<llvm::Module> module;
+    // The number of double lanes the expression is currently emitted for.
+    unsigned width = 1;
+    MathPolicy mathPolicy = Strict;
+    MathFunctions mathFunctions = Libm;
+    // The error bound of the Inline math functions, in ulps.
+    unsigned mathErrorBound = 1;
  public:
     IRVisitor();
     ~IRVisitor();
-    llvm::Value* visit(Expr expr);
-    llvm::ExecutionEngine *create_engine();
+    void emit(const Graph &graph);
+    void clear_values();
+    void set_math_policy(MathPolicy policy);
+    void set_math_functions(MathFunctions functions) { mathFunctions = functions; }
+    void set_math_error_bound(unsigned ulps) { mathErrorBound = ulps; }
+    void optimize(unsigned level);
+    void create_object(llvm::SmallVectorImpl<char> *object, unsigned level,
+                       std::string cpu, std::string features);
+    llvm::orc::ThreadSafeModule release_module();
     llvm::Value* createValue(double value);
+    llvm::Value* create_param(const std::string &name, double value);
+    void load_params(const Graph &graph);
+    static std::string param_symbol(const std::string &name);
+    std::vector<std::string> params() const;
     llvm::LLVMContext* context();
-    llvm::Function* create_callee(const std::vector<Var> &argumentPlacefolders, std::string name, Expr expr);
-    llvm::Function* create_caller(llvm::Function *callee, const std::vector<double> &arguments, std::string name);
+    llvm::Function* create_callee(const std::vector<Var> &argumentPlacefolders, std::string name, const Graph &graph);
+    llvm::Function* create_caller(llvm::Function *callee, std::string name);
+    llvm::Function* create_guarded_caller(llvm::Function *callee, const std::vector<GuardedCallee> &guarded, std::string name);
+    llvm::Function* create_gradient_caller(llvm::Function *gradient, unsigned arguments, std::string name);
+    llvm::Function* create_batch(const std::vector<Var> &argumentPlacefolders, std::string name, const Graph &graph, unsigned width = 1);
+    llvm::Function* create_gradient(const std::vector<Var> &argumentPlacefolders, std::string name, const Graph &graph, unsigned width = 1);
+    void create_rows(const std::vector<Var> &argumentPlacefolders, llvm::Value *columns, llvm::Value *rows,
+                     const std::vector<llvm::Value*> &outputs, unsigned width,
+                     std::function<std::vector<llvm::Value*>()> body);
+    std::vector<llvm::Value*> create_adjoints(const Graph &graph);
+    llvm::Function* create_jacobian(const std::vector<Var> &argumentPlacefolders, std::string name, const Graph &graph,
+                                    const std::vector<std::pair<int, int>> &sparsity, unsigned width = 1);
+    std::vector<llvm::Value*> create_tangents(const Graph &graph, int slot, const std::vector<int> &outputs);
+    llvm::Value* add_tangents(llvm::Value *left, llvm::Value *right);
+    llvm::Value* create_binary(char op, llvm::Value *left, llvm::Value *right);
+    llvm::Value* create_math_call(std::string name, const std::vector<llvm::Value*> &arguments);
+    llvm::Value* create_power(llvm::Value *base, llvm::Value *exponent);
+    static unsigned host_vector_width();
 };
 
 #endif  // IRVISITOR_HPP_
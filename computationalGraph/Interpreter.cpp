@@ -0,0 +1,102 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <cmath>
+
+#include "Interpreter.hpp"
+
+// Registers of expressions up to this size live on the stack.
+static const int stackRegisters = 64;
+
+Interpreter::Interpreter(const Graph &graph) : instructions(graph.nodes()), arguments(graph.arguments()) {
+    if (graph.outputs().empty()) {
+        throw 1;
+    }
+    result = graph.outputs().front();
+    for (size_t slot = 0; slot < graph.parameters(); slot++) {
+        name2Parameter[graph.parameter_name(slot)] = static_cast<int>(slot);
+        parameters.push_back(graph.parameter_value(slot));
+    }
+}
+
+bool Interpreter::set_param(const std::string &name, double value) {
+    auto found = name2Parameter.find(name);
+    if (found == name2Parameter.end()) {
+        return false;
+    }
+    parameters[found->second] = value;
+    return true;
+}
+
+double Interpreter::run(const double *arguments, double *registers) const {
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Graph::Node &instruction = instructions[i];
+        switch (instruction.opcode) {
+        case Graph::Argument:
+            registers[i] = arguments[instruction.a];
+            break;
+        case Graph::Parameter:
+            registers[i] = parameters[instruction.a];
+            break;
+        case Graph::Constant:
+            registers[i] = instruction.constant;
+            break;
+        case Graph::Add:
+            registers[i] = registers[instruction.a] + registers[instruction.b];
+            break;
+        case Graph::Multiply:
+            registers[i] = registers[instruction.a] * registers[instruction.b];
+            break;
+        case Graph::Divide:
+            registers[i] = registers[instruction.a] / registers[instruction.b];
+            break;
+        case Graph::Sine:
+            registers[i] = std::sin(registers[instruction.a]);
+            break;
+        case Graph::Power:
+            registers[i] = std::pow(registers[instruction.a], registers[instruction.b]);
+            break;
+        }
+    }
+    return registers[result];
+}
+
+double Interpreter::evaluate(const double *arguments) const {
+    if (instructions.size() <= stackRegisters) {
+        double registers[stackRegisters];
+        return run(arguments, registers);
+    }
+    std::vector<double> registers(instructions.size());
+    return run(arguments, registers.data());
+}
+
+void Interpreter::evaluate(const double *const *columns, int64_t rows, double *out) const {
+    std::vector<double> registers(instructions.size());
+    std::vector<double> arguments(this->arguments);
+    for (int64_t row = 0; row < rows; row++) {
+        for (size_t k = 0; k < arguments.size(); k++) {
+            arguments[k] = columns[k][row];
+        }
+        out[row] = run(arguments.data(), registers.data());
+    }
+}
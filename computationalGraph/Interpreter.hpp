@@ -0,0 +1,62 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef INTERPRETER_HPP_
+#define INTERPRETER_HPP_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Graph.hpp"
+
+/// Interpreter - Evaluates a Graph by scanning its nodes, without
+/// generating any machine code, so that it is ready microseconds after
+/// construction.
+///
+/// Every node is an instruction which writes the register with its own
+/// index, and reads registers written before it. Evaluation only reads the
+/// instructions, so it is safe from any number of threads.
+class Interpreter {
+    std::vector<Graph::Node> instructions;
+    int result;
+    unsigned arguments;
+    std::map<std::string, int> name2Parameter;
+    std::vector<double> parameters;
+
+    double run(const double *arguments, double *registers) const;
+
+ public:
+    // Evaluates the first output of graph.
+    explicit Interpreter(const Graph &graph);
+
+    // Returns false if the expression has no such Param.
+    bool set_param(const std::string &name, double value);
+
+    double evaluate(const double *arguments) const;
+    // Same ABI as Func::evaluate.
+    void evaluate(const double *const *columns, int64_t rows, double *out) const;
+};
+
+#endif  // INTERPRETER_HPP_
@@ -0,0 +1,150 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+
+#include "JIT.hpp"
+#include "KernelCache.hpp"
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Forwards to the disk cache of KernelCache::shared(), which can be set or
+// replaced after the JIT was created.
+class SharedObjectCache : public llvm::ObjectCache {
+    // Other modules have names which don't identify their code.
+    static bool cacheable(const llvm::Module *module) {
+        return module->getModuleIdentifier().compare(0, 3, "ir-") == 0;
+    }
+
+ public:
+    void notifyObjectCompiled(const llvm::Module *module, llvm::MemoryBufferRef object) override {
+        DiskObjectCache *diskCache = KernelCache::shared().disk_cache();
+        if (diskCache != nullptr && cacheable(module)) {
+            diskCache->notifyObjectCompiled(module, object);
+        }
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *module) override {
+        DiskObjectCache *diskCache = KernelCache::shared().disk_cache();
+        if (diskCache != nullptr && cacheable(module)) {
+            return diskCache->getObject(module);
+        }
+        return nullptr;
+    }
+};
+
+static SharedObjectCache sharedObjectCache;
+
+uint64_t JITModule::address(const std::string &name) const {
+    auto symbol = jit->lookup(*dylib, name);
+    if (!symbol) {
+        llvm::logAllUnhandledErrors(symbol.takeError(), llvm::errs(), "JIT: ");
+        throw 1;
+    }
+    return symbol->getAddress();
+}
+
+JIT::JIT() {
+    dylibs = 0;
+}
+
+JIT& JIT::shared() {
+    static JIT jit;
+    return jit;
+}
+
+llvm::orc::LLJIT& JIT::jit(unsigned level) {
+    level = std::min(level, 3u);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (jits[level] != nullptr) {
+        return *jits[level];
+    }
+
+    // Generate code for the host CPU, so that vector kernels use its registers.
+    auto targetMachineBuilder = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!targetMachineBuilder) {
+        llvm::logAllUnhandledErrors(targetMachineBuilder.takeError(), llvm::errs(), "JIT: ");
+        throw 1;
+    }
+    targetMachineBuilder->setCPU(llvm::sys::getHostCPUName().str());
+    const llvm::CodeGenOpt::Level codeGenLevels[] = {
+        llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less, llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive};
+    targetMachineBuilder->setCodeGenOptLevel(codeGenLevels[level]);
+
+    llvm::orc::LLJITBuilder builder;
+    builder.setJITTargetMachineBuilder(std::move(*targetMachineBuilder));
+    // ConcurrentIRCompiler creates a TargetMachine per module, so that
+    // modules can be compiled on several threads at once.
+    builder.setCompileFunctionCreator([](llvm::orc::JITTargetMachineBuilder targetMachineBuilder)
+                                      -> llvm::Expected<llvm::orc::IRCompileLayer::CompileFunction> {
+        return llvm::orc::ConcurrentIRCompiler(std::move(targetMachineBuilder), &sharedObjectCache);
+    });
+    auto created = builder.create();
+    if (!created) {
+        llvm::logAllUnhandledErrors(created.takeError(), llvm::errs(), "JIT: ");
+        throw 1;
+    }
+    jits[level] = std::move(*created);
+    return *jits[level];
+}
+
+llvm::orc::JITDylib& JIT::create_dylib(llvm::orc::LLJIT &lljit) {
+    std::string name = "kernel" + std::to_string(dylibs++);
+    llvm::orc::JITDylib &dylib = lljit.createJITDylib(name);
+    // Resolve calls to the math library from the process.
+    dylib.setGenerator(llvm::cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(lljit.getDataLayout())));
+    return dylib;
+}
+
+JITModule JIT::add(llvm::orc::ThreadSafeModule module, unsigned level) {
+    llvm::orc::LLJIT &lljit = jit(level);
+    llvm::orc::JITDylib &dylib = create_dylib(lljit);
+    if (auto error = lljit.addIRModule(dylib, std::move(module))) {
+        llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "JIT: ");
+        throw 1;
+    }
+
+    JITModule linked;
+    linked.jit = &lljit;
+    linked.dylib = &dylib;
+    return linked;
+}
+
+JITModule JIT::add_object(std::unique_ptr<llvm::MemoryBuffer> object, unsigned level) {
+    llvm::orc::LLJIT &lljit = jit(level);
+    llvm::orc::JITDylib &dylib = create_dylib(lljit);
+    if (auto error = lljit.addObjectFile(dylib, std::move(object))) {
+        llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "JIT: ");
+        throw 1;
+    }
+
+    JITModule linked;
+    linked.jit = &lljit;
+    linked.dylib = &dylib;
+    return linked;
+}
@@ -0,0 +1,74 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef JIT_HPP_
+#define JIT_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+/// JITModule - A module linked by the JIT, to look its functions up in.
+struct JITModule {
+    llvm::orc::LLJIT *jit = nullptr;
+    llvm::orc::JITDylib *dylib = nullptr;
+
+    // The address of the function name, which is compiled on first lookup.
+    uint64_t address(const std::string &name) const;
+};
+
+/// JIT - The process-wide ORCv2 LLJIT which links every compiled kernel.
+///
+/// Every module comes with an LLVMContext of its own in a ThreadSafeModule
+/// and is added to a JITDylib of its own, so that kernels can define the
+/// same function names. Any number of threads can thus generate, compile
+/// and look up kernels at the same time. Linked code is kept until exit.
+class JIT {
+    std::mutex mutex;
+    // One LLJIT per code generation level 0-3, created on first use.
+    std::unique_ptr<llvm::orc::LLJIT> jits[4];
+    std::atomic<uint64_t> dylibs;
+
+    llvm::orc::LLJIT& jit(unsigned level);
+    llvm::orc::JITDylib& create_dylib(llvm::orc::LLJIT &lljit);
+
+ public:
+    JIT();
+
+    static JIT& shared();
+
+    // Link module, generating code for it at level when it is looked up.
+    // Objects of modules named by DiskObjectCache::content_identifier are
+    // loaded from and stored in the disk cache of KernelCache::shared().
+    JITModule add(llvm::orc::ThreadSafeModule module, unsigned level);
+    // Link an object compiled before, e.g. one loaded from the disk cache.
+    JITModule add_object(std::unique_ptr<llvm::MemoryBuffer> object, unsigned level);
+};
+
+#endif  // JIT_HPP_
@@ -0,0 +1,130 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <set>
+
+#include "Jacobian.hpp"
+#include "IRVisitor.hpp"
+#include "Simplifier.hpp"
+
+Jacobian::Jacobian() {
+    kernel = NULL;
+    vectorWidth = 0;
+    optimizationLevel = 2;
+    mathPolicy = IRVisitor::Strict;
+    mathFunctions = IRVisitor::Libm;
+    mathErrorBound = 1;
+}
+
+// Find the arguments each output depends on by scanning the graph backwards
+// from it, marking the operands of every node reached.
+void Jacobian::detect_sparsity() {
+    pattern.clear();
+    for (size_t j = 0; j < graph.outputs().size(); j++) {
+        std::vector<bool> reached(graph.size(), false);
+        std::set<int> arguments;
+        reached[graph.outputs()[j]] = true;
+        for (int i = graph.outputs()[j]; i >= 0; i--) {
+            if (!reached[i]) {
+                continue;
+            }
+            const Graph::Node &node = graph[i];
+            if (node.opcode == Graph::Argument) {
+                arguments.insert(node.a);
+            }
+            int operands = Graph::arity(node.opcode);
+            if (operands > 0) {
+                reached[node.a] = true;
+            }
+            if (operands > 1) {
+                reached[node.b] = true;
+            }
+        }
+        for (auto k : arguments) {
+            pattern.push_back(std::make_pair(j, k));
+        }
+    }
+}
+
+void Jacobian::realise() {
+    // One graph for all outputs, so that subtrees they share stay shared.
+    graph = Simplifier(argumentPlacefolders.size()).run(Graph(argumentPlacefolders, outputs));
+    detect_sparsity();
+
+    unsigned width = vectorWidth > 0 ? vectorWidth : IRVisitor::host_vector_width();
+    IRVisitor* visitor = new IRVisitor();
+    visitor->set_math_policy(mathPolicy);
+    visitor->set_math_functions(mathFunctions);
+    visitor->set_math_error_bound(mathErrorBound);
+    visitor->create_jacobian(argumentPlacefolders, "jacobian", graph, pattern, width);
+    visitor->optimize(optimizationLevel);
+    std::vector<std::string> names = visitor->params();
+    module = JIT::shared().add(visitor->release_module(), optimizationLevel);
+    kernel = reinterpret_cast<void(*)(const double**, int64_t, double**)>(module.address("jacobian"));
+    params.clear();
+    for (auto &name : names) {
+        params[name] = reinterpret_cast<double*>(module.address(IRVisitor::param_symbol(name)));
+    }
+    for (auto &param : paramValues) {
+        auto found = params.find(param.first);
+        if (found != params.end()) {
+            *found->second = param.second;
+        }
+    }
+    delete visitor;
+}
+
+void Jacobian::set_param(const std::string &name, double value) {
+    paramValues[name] = value;
+    if (kernel == NULL) {
+        return;
+    }
+    auto found = params.find(name);
+    if (found == params.end()) {
+        // Not a Param of this Jacobian.
+        throw 1;
+    }
+    *found->second = value;
+}
+
+void Jacobian::operator()(const std::vector<double> &arguments, double *values, double *entries) {
+    std::vector<const double*> columns;
+    for (size_t i = 0; i < arguments.size(); i++) {
+        columns.push_back(&arguments[i]);
+    }
+    std::vector<double*> out;
+    for (size_t j = 0; j < outputs.size(); j++) {
+        out.push_back(&values[j]);
+    }
+    for (size_t e = 0; e < pattern.size(); e++) {
+        out.push_back(&entries[e]);
+    }
+    evaluate(columns, 1, out);
+}
+
+void Jacobian::evaluate(const std::vector<const double*> &columns, int64_t rows, const std::vector<double*> &out) {
+    if (kernel == NULL || columns.size() != argumentPlacefolders.size() || out.size() != outputs.size() + pattern.size()) {
+        throw 1;
+    }
+    kernel(const_cast<const double**>(columns.data()), rows, const_cast<double**>(out.data()));
+}
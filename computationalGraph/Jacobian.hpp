@@ -0,0 +1,109 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef JACOBIAN_HPP_
+#define JACOBIAN_HPP_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Expr.hpp"
+#include "Graph.hpp"
+#include "IRVisitor.hpp"
+#include "JIT.hpp"
+#include "Var.hpp"
+
+/// Jacobian - A vector-valued function compiled together with its Jacobian.
+///
+///   Jacobian j;
+///   Var a, b;
+///   j(a, b) = {a * b, F::sin(a)};
+///   j.realise();
+///
+/// Only the entries which are structurally non-zero, i.e. where the output
+/// reaches the argument through its graph, are computed and stored. They
+/// are written to a compressed buffer in the order given by sparsity().
+class Jacobian {
+ private:
+    std::vector<Expr> outputs;
+    // outputs lowered into one graph and simplified, which is what realise()
+    // generates code for.
+    Graph graph;
+    std::vector<Var> argumentPlacefolders;
+    std::vector<std::pair<int, int>> pattern;
+    JITModule module;
+    void (*kernel)(const double **columns, int64_t rows, double **out);
+    unsigned vectorWidth;
+    unsigned optimizationLevel;
+    IRVisitor::MathPolicy mathPolicy;
+    IRVisitor::MathFunctions mathFunctions;
+    unsigned mathErrorBound;
+    // Where the kernel reads each Param from, and the values given to
+    // set_param, which the kernel of every realise() gets.
+    std::map<std::string, double*> params;
+    std::map<std::string, double> paramValues;
+
+    void detect_sparsity();
+
+ public:
+    Jacobian();
+
+    std::vector<Expr>& operator()(std::vector<Var> arg) {
+        argumentPlacefolders = arg;
+        return outputs;
+    }
+    template <typename... Args> std::vector<Expr>& operator()(Var x, Args&&... args) {
+        std::vector<Var> collected_args{x, std::forward<Args>(args)...};
+        return this->operator()(collected_args);
+    }
+
+    void set_vector_width(unsigned width) { vectorWidth = width; }
+    void set_optimization_level(unsigned level) { optimizationLevel = level; }
+    void set_math_policy(IRVisitor::MathPolicy policy) { mathPolicy = policy; }
+    void set_math_functions(IRVisitor::MathFunctions functions) { mathFunctions = functions; }
+    void set_math_error_bound(unsigned ulps) { mathErrorBound = ulps; }
+
+    void realise();
+
+    // Change the value of the Param name, which the kernel reads from then
+    // on, without compiling anything.
+    void set_param(const std::string &name, double value);
+
+    // The (output, argument) index of every stored entry, ordered by output
+    // and then by argument.
+    const std::vector<std::pair<int, int>>& sparsity() const { return pattern; }
+
+    // Evaluate one point. values receives one value per output and entries
+    // one value per element of sparsity().
+    void operator()(const std::vector<double> &arguments, double *values, double *entries);
+
+    // Evaluate rows points. out holds outputs + sparsity().size() arrays, for
+    // the values of each output and then for each stored entry.
+    void evaluate(const std::vector<const double*> &columns, int64_t rows, const std::vector<double*> &out);
+};
+
+#endif  // JACOBIAN_HPP_
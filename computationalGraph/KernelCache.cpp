@@ -0,0 +1,162 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <sstream>
+
+#include "KernelCache.hpp"
+
+void ExprHasher::update(const Graph &graph) {
+    static const char *operations[] = {"arg", "param", "num", "+", "*", "/", "sin", "pow"};
+    for (size_t i = hashes.size(); i < graph.size(); i++) {
+        const Graph::Node &node = graph[i];
+        switch (node.opcode) {
+        case Graph::Argument:
+            hashes.push_back(record("arg" + std::to_string(node.a), {}));
+            break;
+        case Graph::Parameter:
+            hashes.push_back(record("param:" + graph.parameter_name(node.a), {}));
+            break;
+        case Graph::Constant: {
+            // hexfloat keeps every bit of the value.
+            std::ostringstream stream;
+            stream << std::hexfloat << node.constant;
+            hashes.push_back(record("num:" + stream.str(), {}));
+            break;
+        }
+        default:
+            if (Graph::arity(node.opcode) == 1) {
+                hashes.push_back(record(operations[node.opcode], {hashes[node.a]}));
+            } else {
+                hashes.push_back(record(operations[node.opcode], {hashes[node.a], hashes[node.b]}));
+            }
+            break;
+        }
+    }
+}
+
+// Append value in lower case hex without leading zeros, like std::hex.
+static void append_hex(std::string *line, uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    char reversed[16];
+    int count = 0;
+    do {
+        reversed[count++] = digits[value & 15];
+        value >>= 4;
+    } while (value != 0);
+    while (count > 0) {
+        line->push_back(reversed[--count]);
+    }
+}
+
+uint64_t ExprHasher::record(const std::string &operation, const std::vector<uint64_t> &operands) {
+    std::vector<uint64_t> ordered = operands;
+    // + and * are commutative.
+    if (operation == "+" || operation == "*") {
+        std::sort(ordered.begin(), ordered.end());
+    }
+    // Formatted by hand, since a stream per node is slow on large graphs.
+    std::string line = operation;
+    for (auto operand : ordered) {
+        line.push_back(' ');
+        append_hex(&line, operand);
+    }
+
+    // 64 bit FNV-1a, which gives the same hash on every run and platform.
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : line) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    if (keepRecords) {
+        hash2Record[hash] = line;
+    }
+    return hash;
+}
+
+std::string ExprHasher::signature() const {
+    std::vector<uint64_t> hashes;
+    for (auto &record : hash2Record) {
+        hashes.push_back(record.first);
+    }
+    std::sort(hashes.begin(), hashes.end());
+    std::string signature;
+    for (auto hash : hashes) {
+        append_hex(&signature, hash);
+        signature += "=" + hash2Record.at(hash) + ";";
+    }
+    return signature;
+}
+
+KernelCache& KernelCache::shared() {
+    static KernelCache cache;
+    return cache;
+}
+
+std::string KernelCache::key(const Graph &graph, const std::string &options) {
+    ExprHasher hasher;
+    hasher.update(graph);
+    std::ostringstream stream;
+    stream << "arity=" << graph.arguments()
+        << "," << options;
+    for (int output : graph.outputs()) {
+        stream << ",result=" << std::hex << hasher.hash(output);
+    }
+    stream << "|" << hasher.signature();
+    return stream.str();
+}
+
+std::shared_ptr<Kernel> KernelCache::find(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = kernels.find(key);
+    if (found == kernels.end()) {
+        return nullptr;
+    }
+    return found->second;
+}
+
+std::shared_ptr<Kernel> KernelCache::insert(const std::string &key, std::shared_ptr<Kernel> kernel) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto inserted = kernels.insert(std::make_pair(key, kernel));
+    return inserted.first->second;
+}
+
+void KernelCache::erase(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    kernels.erase(key);
+}
+
+void KernelCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    kernels.clear();
+}
+
+void KernelCache::set_disk_cache(const std::string &directory, uint64_t maxBytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    diskCache.reset(new DiskObjectCache(directory, maxBytes));
+}
+
+DiskObjectCache* KernelCache::disk_cache() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return diskCache.get();
+}
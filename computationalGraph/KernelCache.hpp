@@ -0,0 +1,99 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef KERNELCACHE_HPP_
+#define KERNELCACHE_HPP_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DiskObjectCache.hpp"
+#include "Graph.hpp"
+#include "JIT.hpp"
+
+/// ExprHasher - Computes the canonical structural hash of every node of a
+/// Graph. Variables are identified by their argument slot and operands of
+/// commutative operations are ordered by hash, so the hash does not depend
+/// on variable names, on the order the graph was built in, or on which
+/// subtrees happen to be shared.
+class ExprHasher {
+    bool keepRecords;
+    std::vector<uint64_t> hashes;
+    // One record per distinct subtree, which signature orders by hash.
+    std::unordered_map<uint64_t, std::string> hash2Record;
+
+    uint64_t record(const std::string &operation, const std::vector<uint64_t> &operands);
+
+ public:
+    // Without records, signature is empty, which saves their memory when
+    // only the hashes are wanted.
+    explicit ExprHasher(bool records = true) : keepRecords(records) {}
+    // Hash the nodes appended to graph since the last call.
+    void update(const Graph &graph);
+    uint64_t hash(int node) const { return hashes[node]; }
+    std::string signature() const;
+};
+
+/// Kernel - Machine code compiled for one expression, shared by every Func
+/// realised with a structurally equal expression and the same options.
+struct Kernel {
+    JITModule module;
+    void (*batch)(const double **columns, int64_t rows, double *out) = nullptr;
+    void (*gradient)(const double **columns, int64_t rows, double **out) = nullptr;
+    // Single point entry points, which take the arguments as one array.
+    void (*call)(const double *arguments, double *out) = nullptr;
+    void (*gradient_call)(const double *arguments, double *out) = nullptr;
+    // Where the code reads each Param from, by name.
+    std::map<std::string, double*> params;
+};
+
+/// KernelCache - Process-wide table of compiled kernels, optionally backed
+/// by a DiskObjectCache for the objects they are linked from.
+class KernelCache {
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<Kernel>> kernels;
+    std::unique_ptr<DiskObjectCache> diskCache;
+
+ public:
+    static KernelCache& shared();
+    // options describes everything else which changes the generated code.
+    static std::string key(const Graph &graph, const std::string &options);
+
+    std::shared_ptr<Kernel> find(const std::string &key);
+    // Returns the kernel already registered for key if there is one.
+    std::shared_ptr<Kernel> insert(const std::string &key, std::shared_ptr<Kernel> kernel);
+    // Forget the kernel of key. Funcs holding it keep it alive.
+    void erase(const std::string &key);
+    void clear();
+
+    // Keep compiled objects in directory as well, so that they survive restarts.
+    void set_disk_cache(const std::string &directory, uint64_t maxBytes);
+    DiskObjectCache* disk_cache();
+};
+
+#endif  // KERNELCACHE_HPP_
@@ -0,0 +1,457 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "MathLibrary.hpp"
+
+#include "llvm/IR/Intrinsics.h"
+
+MathLibrary::MathLibrary(llvm::Module *module, unsigned ulps)
+    : module(module), ulps(ulps), builder(module->getContext()),
+      doubleType(nullptr), integerType(nullptr), width(1) {
+}
+
+llvm::Value* MathLibrary::number(double value) {
+    return llvm::ConstantFP::get(doubleType, value);
+}
+
+llvm::Value* MathLibrary::integer(int64_t value) {
+    return llvm::ConstantInt::get(integerType, static_cast<uint64_t>(value), true);
+}
+
+llvm::Value* MathLibrary::bits(llvm::Value *value) {
+    return builder.CreateBitCast(value, integerType);
+}
+
+llvm::Value* MathLibrary::real(llvm::Value *bits) {
+    return builder.CreateBitCast(bits, doubleType);
+}
+
+// value with the low 32 bits of its significand cleared, so that products
+// of it with other such values are exact, as SET_LOW_WORD(x, 0) in fdlibm.
+llvm::Value* MathLibrary::clear_low_word(llvm::Value *value) {
+    return real(builder.CreateAnd(bits(value), integer(static_cast<int64_t>(0xffffffff00000000ULL))));
+}
+
+llvm::Value* MathLibrary::fabs(llvm::Value *value) {
+    llvm::Function *func = llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::fabs, {doubleType});
+    return builder.CreateCall(func, {value});
+}
+
+// coefficients[0] + x * (coefficients[1] + x * (...)), by Horner's rule.
+llvm::Value* MathLibrary::polynomial(llvm::Value *x, const std::vector<double> &coefficients) {
+    llvm::Value *sum = number(coefficients.back());
+    for (size_t i = coefficients.size() - 1; i > 0; i--) {
+        sum = builder.CreateFAdd(builder.CreateFMul(sum, x), number(coefficients[i - 1]));
+    }
+    return sum;
+}
+
+// Round value, |value| < 2^51, to the nearest integer, as a double and as
+// an integer. Adding 1.5 * 2^52 leaves the integer in the low bits of the
+// significand. None of the instructions has fast-math flags, so this isn't
+// folded away whatever flags the kernel uses.
+void MathLibrary::round(llvm::Value *value, llvm::Value **rounded, llvm::Value **integral) {
+    const double shifter = 6755399441055744.0;
+    llvm::Value *shifted = builder.CreateFAdd(value, number(shifter));
+    *rounded = builder.CreateFSub(shifted, number(shifter));
+    *integral = builder.CreateSub(bits(shifted), integer(0x4338000000000000LL));
+}
+
+// value * 2^exponent, for exponents from -1022 to 1023.
+llvm::Value* MathLibrary::scale(llvm::Value *value, llvm::Value *exponent) {
+    llvm::Value *power = builder.CreateShl(builder.CreateAdd(exponent, integer(1023)), integer(52));
+    return builder.CreateFMul(value, real(power));
+}
+
+// The polynomials leave about 2 ulps of the bound for rounding.
+double MathLibrary::truncation(unsigned bound) {
+    return (bound - 2) * std::ldexp(1.0, -53);
+}
+
+llvm::Value* MathLibrary::emit_exp(llvm::Value *x, unsigned bound, llvm::Value **ordinary) {
+    const double invln2 = 1.44269504088896338700e+00;
+    const double ln2HI = 6.93147180369123816490e-01;
+    const double ln2LO = 1.90821492927058770002e-10;
+    *ordinary = builder.CreateFCmpOLE(fabs(x), number(708.0));
+
+    // x = k * ln2 + r, |r| <= ln2 / 2, where k * ln2HI is exact.
+    llvm::Value *kf, *k;
+    round(builder.CreateFMul(x, number(invln2)), &kf, &k);
+    llvm::Value *hi = builder.CreateFSub(x, builder.CreateFMul(kf, number(ln2HI)));
+    llvm::Value *lo = builder.CreateFMul(kf, number(ln2LO));
+    llvm::Value *r = builder.CreateFSub(hi, lo);
+
+    llvm::Value *y;
+    if (bound >= 4) {
+        // The first omitted term of the Taylor series, r^n / n! times at
+        // most exp(0.35), relative to exp(r) >= 0.7.
+        std::vector<double> coefficients{1.0, 1.0};
+        double power = 0.35 * 0.35, factorial = 2;
+        while (2 * power / factorial > truncation(bound)) {
+            coefficients.push_back(1 / factorial);
+            power *= 0.35;
+            factorial *= coefficients.size();
+        }
+        y = polynomial(r, coefficients);
+    } else {
+        // exp(r) = 1 + r + r * c / (2 - c), fdlibm's e_exp.c.
+        llvm::Value *t = builder.CreateFMul(r, r);
+        llvm::Value *c = builder.CreateFSub(r, builder.CreateFMul(t, polynomial(t, {
+            1.66666666666666019037e-01, -2.77777777770155933842e-03, 6.61375632143793436117e-05,
+            -1.65339022054652515390e-06, 4.13813679705723846039e-08})));
+        llvm::Value *quotient = builder.CreateFDiv(builder.CreateFMul(r, c), builder.CreateFSub(number(2.0), c));
+        y = builder.CreateFSub(number(1.0), builder.CreateFSub(builder.CreateFSub(lo, quotient), hi));
+    }
+    return scale(y, k);
+}
+
+llvm::Value* MathLibrary::emit_log(llvm::Value *x, unsigned bound, llvm::Value **ordinary) {
+    const double ln2HI = 6.93147180369123816490e-01;
+    const double ln2LO = 1.90821492927058770002e-10;
+    *ordinary = builder.CreateAnd(builder.CreateFCmpOGE(x, number(2.2250738585072014e-308)),
+                                  builder.CreateFCmpOLT(x, number(INFINITY)));
+
+    // x = 2^k * m, sqrt(2) / 2 < m <= sqrt(2), and f = m - 1 exactly.
+    llvm::Value *b = bits(x);
+    llvm::Value *k = builder.CreateSub(builder.CreateLShr(b, integer(52)), integer(1023));
+    llvm::Value *m = real(builder.CreateOr(builder.CreateAnd(b, integer(0x000fffffffffffffLL)), integer(0x3ff0000000000000LL)));
+    llvm::Value *above = builder.CreateFCmpOGT(m, number(1.4142135623730951));
+    m = builder.CreateSelect(above, builder.CreateFMul(m, number(0.5)), m);
+    k = builder.CreateSelect(above, builder.CreateAdd(k, integer(1)), k);
+    llvm::Value *f = builder.CreateFSub(m, number(1.0));
+    llvm::Value *kf = builder.CreateSIToFP(k, doubleType);
+
+    // log(1 + f) = 2 atanh(s), s = f / (2 + f), |s| < 0.1716.
+    llvm::Value *s = builder.CreateFDiv(f, builder.CreateFAdd(number(2.0), f));
+    llvm::Value *z = builder.CreateFMul(s, s);
+    if (bound >= 4) {
+        // The omitted terms of 2 s (1 + s^2 / 3 + s^4 / 5 + ...), relative to 2 s.
+        std::vector<double> coefficients{2.0};
+        double power = 0.1716 * 0.1716;
+        while (power / (2 * coefficients.size() + 1) / (1 - 0.1716 * 0.1716) > truncation(bound)) {
+            coefficients.push_back(2.0 / (2 * coefficients.size() + 1));
+            power *= 0.1716 * 0.1716;
+        }
+        llvm::Value *logarithm = builder.CreateFAdd(builder.CreateFMul(s, polynomial(z, coefficients)),
+                                                    builder.CreateFMul(kf, number(ln2LO)));
+        return builder.CreateFAdd(builder.CreateFMul(kf, number(ln2HI)), logarithm);
+    }
+
+    // fdlibm's e_log.c: log(1 + f) = f - f^2 / 2 + s * (f^2 / 2 + R(z)).
+    llvm::Value *hfsq = builder.CreateFMul(builder.CreateFMul(number(0.5), f), f);
+    llvm::Value *w = builder.CreateFMul(z, z);
+    llvm::Value *t1 = builder.CreateFMul(w, polynomial(w, {
+        3.999999999940941908e-01, 2.222219843214978396e-01, 1.531383769920937332e-01}));
+    llvm::Value *t2 = builder.CreateFMul(z, polynomial(w, {
+        6.666666666666735130e-01, 2.857142874366239149e-01, 1.818357216161805012e-01, 1.479819860511658591e-01}));
+    llvm::Value *R = builder.CreateFAdd(t2, t1);
+    llvm::Value *correction = builder.CreateFAdd(builder.CreateFMul(s, builder.CreateFAdd(hfsq, R)),
+                                                 builder.CreateFMul(kf, number(ln2LO)));
+    llvm::Value *tail = builder.CreateFSub(builder.CreateFSub(hfsq, correction), f);
+    return builder.CreateFSub(builder.CreateFMul(kf, number(ln2HI)), tail);
+}
+
+llvm::Value* MathLibrary::emit_sincos(llvm::Value *x, bool cosine, unsigned bound, llvm::Value **ordinary) {
+    const double invpio2 = 6.36619772367581382433e-01;
+    // pi / 2 in 33 bit pieces, so that multiples of up to 2^20 are exact.
+    const double pio2_1 = 1.57079632673412561417e+00;
+    const double pio2_1t = 6.07710050650619224932e-11;
+    const double pio2_2 = 6.07710050630396597660e-11;
+    const double pio2_3 = 2.02226624871116645580e-21;
+    const double pio2_3t = 8.47842766036889956997e-32;
+    *ordinary = builder.CreateFCmpOLE(fabs(x), number(1048576.0));
+
+    // x = k * pi / 2 + y, |y| <= pi / 4, and the quadrant k mod 4.
+    llvm::Value *kf, *k;
+    round(builder.CreateFMul(x, number(invpio2)), &kf, &k);
+    llvm::Value *quadrant = builder.CreateAnd(k, integer(3));
+    llvm::Value *a = builder.CreateFSub(x, builder.CreateFMul(kf, number(pio2_1)));
+
+    llvm::Value *sine, *cosine_;
+    if (bound >= 4) {
+        llvm::Value *y = builder.CreateFSub(a, builder.CreateFMul(kf, number(pio2_1t)));
+        llvm::Value *z = builder.CreateFMul(y, y);
+        // The first omitted terms of the Taylor series, relative to
+        // sin(y) >= 0.9 y and to cos(y) >= 0.7.
+        const double quarter = 0.7854;
+        std::vector<double> sineCoefficients{1.0}, cosineCoefficients{1.0};
+        double factorial = 6, power = quarter * quarter;
+        for (unsigned i = 1; power / factorial / 0.9 > truncation(bound); i++) {
+            sineCoefficients.push_back((i % 2 ? -1.0 : 1.0) / factorial);
+            factorial *= (2 * i + 2) * (2 * i + 3);
+            power *= quarter * quarter;
+        }
+        factorial = 2, power = quarter * quarter;
+        for (unsigned i = 1; power / factorial / 0.7 > truncation(bound); i++) {
+            cosineCoefficients.push_back((i % 2 ? -1.0 : 1.0) / factorial);
+            factorial *= (2 * i + 1) * (2 * i + 2);
+            power *= quarter * quarter;
+        }
+        sine = builder.CreateFMul(y, polynomial(z, sineCoefficients));
+        cosine_ = polynomial(z, cosineCoefficients);
+    } else {
+        // Subtract k * pi / 2 in double-double, pi / 2 being known to 152
+        // bits, which keeps y accurate even close to a multiple of pi / 2.
+        auto difference = [&](llvm::Value *left, llvm::Value *right, llvm::Value **error) {
+            llvm::Value *sum = builder.CreateFSub(left, right);
+            llvm::Value *virtualRight = builder.CreateFSub(left, sum);
+            llvm::Value *virtualLeft = builder.CreateFSub(sum, builder.CreateFNeg(virtualRight));
+            *error = builder.CreateFAdd(builder.CreateFSub(left, virtualLeft),
+                                        builder.CreateFSub(virtualRight, right));
+            return sum;
+        };
+        llvm::Value *e1, *e2;
+        llvm::Value *s1 = difference(a, builder.CreateFMul(kf, number(pio2_2)), &e1);
+        llvm::Value *s2 = difference(s1, builder.CreateFMul(kf, number(pio2_3)), &e2);
+        llvm::Value *lo = builder.CreateFSub(builder.CreateFAdd(e1, e2), builder.CreateFMul(kf, number(pio2_3t)));
+        llvm::Value *y0 = builder.CreateFAdd(s2, lo);
+        llvm::Value *y1 = builder.CreateFSub(lo, builder.CreateFSub(y0, s2));
+
+        // fdlibm's k_sin.c and k_cos.c, on y0 + y1.
+        llvm::Value *z = builder.CreateFMul(y0, y0);
+        llvm::Value *v = builder.CreateFMul(z, y0);
+        llvm::Value *r = polynomial(z, {8.33333333332248946124e-03, -1.98412698298579493134e-04,
+            2.75573137070700676789e-06, -2.50507602534068634195e-08, 1.58969099521155010221e-10});
+        llvm::Value *inner = builder.CreateFSub(builder.CreateFMul(number(0.5), y1), builder.CreateFMul(v, r));
+        inner = builder.CreateFSub(builder.CreateFMul(z, inner), y1);
+        inner = builder.CreateFSub(inner, builder.CreateFMul(v, number(-1.66666666666666324348e-01)));
+        sine = builder.CreateFSub(y0, inner);
+
+        r = builder.CreateFMul(z, polynomial(z, {4.16666666666666019037e-02, -1.38888888888741095749e-03,
+            2.48015872894767294178e-05, -2.75573143513906633035e-07, 2.08757232129817482790e-09,
+            -1.13596475577881948265e-11}));
+        llvm::Value *hz = builder.CreateFMul(number(0.5), z);
+        llvm::Value *w = builder.CreateFSub(number(1.0), hz);
+        llvm::Value *tail = builder.CreateFSub(builder.CreateFMul(z, r), builder.CreateFMul(y0, y1));
+        tail = builder.CreateFAdd(builder.CreateFSub(builder.CreateFSub(number(1.0), w), hz), tail);
+        cosine_ = builder.CreateFAdd(w, tail);
+    }
+
+    // sin(x) is sin(y), cos(y), -sin(y), -cos(y) in the quadrants 0 to 3,
+    // and cos(x) is sin(x) a quadrant later.
+    if (cosine) {
+        quadrant = builder.CreateAdd(quadrant, integer(1));
+    }
+    llvm::Value *odd = builder.CreateICmpNE(builder.CreateAnd(quadrant, integer(1)), integer(0));
+    llvm::Value *negative = builder.CreateICmpNE(builder.CreateAnd(quadrant, integer(2)), integer(0));
+    llvm::Value *result = builder.CreateSelect(odd, cosine_, sine);
+    result = builder.CreateSelect(negative, builder.CreateFNeg(result), result);
+    if (!cosine) {
+        // sin(-0) is -0.
+        result = builder.CreateSelect(builder.CreateFCmpOEQ(x, number(0.0)), x, result);
+    }
+    return result;
+}
+
+llvm::Value* MathLibrary::emit_pow(llvm::Value *x, llvm::Value *y, unsigned bound, llvm::Value **ordinary) {
+    if (bound >= 4096) {
+        // An error of e ulps in log(x) and of 0.5 ulps in the product make
+        // up to 709 * (e + 0.5) ulps in the result. exp gets what is left.
+        llvm::Value *logOrdinary, *expOrdinary;
+        unsigned logBound = std::max(4u, bound / 1418);
+        llvm::Value *product = builder.CreateFMul(y, emit_log(x, logBound, &logOrdinary));
+        llvm::Value *result = emit_exp(product, bound - 709 * logBound - 355, &expOrdinary);
+        *ordinary = builder.CreateAnd(logOrdinary, expOrdinary);
+        return result;
+    }
+
+    // fdlibm's e_pow.c for positive normal x: log2(x) = t1 + t2 to about
+    // 2^-64, y * log2(x) = p_h + p_l exactly, and 2^(p_h + p_l).
+    const double dp_h = 5.84962487220764160156e-01;
+    const double dp_l = 1.35003920212974897128e-08;
+    const double lg2 = 6.93147180559945286227e-01;
+    const double lg2_h = 6.93147182464599609375e-01;
+    const double lg2_l = -1.90465429995776804525e-09;
+    const double cp = 9.61796693925975554329e-01;
+    const double cp_h = 9.61796700954437255859e-01;
+    const double cp_l = -7.02846165095275826516e-09;
+    llvm::Value *ordinaryX = builder.CreateAnd(builder.CreateFCmpOGE(x, number(2.2250738585072014e-308)),
+                                               builder.CreateFCmpOLT(x, number(INFINITY)));
+
+    // x = 2^n * ax, ax in [1, sqrt(3)) or [sqrt(3) / 2, 1), and bp is 1 or
+    // 1.5, whichever is closer.
+    llvm::Value *b = bits(x);
+    llvm::Value *ix = builder.CreateLShr(b, integer(32));
+    llvm::Value *n = builder.CreateSub(builder.CreateLShr(ix, integer(20)), integer(0x3ff));
+    llvm::Value *j = builder.CreateAnd(ix, integer(0x000fffff));
+    ix = builder.CreateOr(j, integer(0x3ff00000));
+    llvm::Value *middle = builder.CreateAnd(builder.CreateICmpSGT(j, integer(0x3988E)), builder.CreateICmpSLT(j, integer(0xBB67A)));
+    llvm::Value *upper = builder.CreateICmpSGE(j, integer(0xBB67A));
+    n = builder.CreateSelect(upper, builder.CreateAdd(n, integer(1)), n);
+    ix = builder.CreateSelect(upper, builder.CreateSub(ix, integer(0x00100000)), ix);
+    llvm::Value *ax = real(builder.CreateOr(builder.CreateShl(ix, integer(32)), builder.CreateAnd(b, integer(0xffffffffLL))));
+    llvm::Value *bp = builder.CreateSelect(middle, number(1.5), number(1.0));
+    llvm::Value *dph = builder.CreateSelect(middle, number(dp_h), number(0.0));
+    llvm::Value *dpl = builder.CreateSelect(middle, number(dp_l), number(0.0));
+    llvm::Value *k = builder.CreateZExt(middle, integerType);
+
+    // ss = s_h + s_l = (ax - bp) / (ax + bp).
+    llvm::Value *u = builder.CreateFSub(ax, bp);
+    llvm::Value *v = builder.CreateFDiv(number(1.0), builder.CreateFAdd(ax, bp));
+    llvm::Value *ss = builder.CreateFMul(u, v);
+    llvm::Value *s_h = clear_low_word(ss);
+    llvm::Value *high = builder.CreateAdd(builder.CreateOr(builder.CreateLShr(ix, integer(1)), integer(0x20000000)),
+                                          builder.CreateAdd(integer(0x00080000), builder.CreateShl(k, integer(18))));
+    llvm::Value *t_h = real(builder.CreateShl(high, integer(32)));
+    llvm::Value *t_l = builder.CreateFSub(ax, builder.CreateFSub(t_h, bp));
+    llvm::Value *s_l = builder.CreateFMul(v, builder.CreateFSub(builder.CreateFSub(u, builder.CreateFMul(s_h, t_h)),
+                                                                builder.CreateFMul(s_h, t_l)));
+
+    // log(ax).
+    llvm::Value *s2 = builder.CreateFMul(ss, ss);
+    llvm::Value *r = builder.CreateFMul(builder.CreateFMul(s2, s2), polynomial(s2, {
+        5.99999999999994648725e-01, 4.28571428578550184252e-01, 3.33333329818377432918e-01,
+        2.72728123808534006489e-01, 2.30660745775561754067e-01, 2.06975017800338417784e-01}));
+    r = builder.CreateFAdd(r, builder.CreateFMul(s_l, builder.CreateFAdd(s_h, ss)));
+    s2 = builder.CreateFMul(s_h, s_h);
+    t_h = clear_low_word(builder.CreateFAdd(builder.CreateFAdd(number(3.0), s2), r));
+    t_l = builder.CreateFSub(r, builder.CreateFSub(builder.CreateFSub(t_h, number(3.0)), s2));
+    u = builder.CreateFMul(s_h, t_h);
+    v = builder.CreateFAdd(builder.CreateFMul(s_l, t_h), builder.CreateFMul(t_l, ss));
+    llvm::Value *p_h = clear_low_word(builder.CreateFAdd(u, v));
+    llvm::Value *p_l = builder.CreateFSub(v, builder.CreateFSub(p_h, u));
+    llvm::Value *z_h = builder.CreateFMul(number(cp_h), p_h);
+    llvm::Value *z_l = builder.CreateFAdd(builder.CreateFAdd(builder.CreateFMul(number(cp_l), p_h),
+                                                             builder.CreateFMul(p_l, number(cp))), dpl);
+
+    // log2(x) = t1 + t2 = n + dp_h + z_h + z_l.
+    llvm::Value *t = builder.CreateSIToFP(n, doubleType);
+    llvm::Value *t1 = clear_low_word(builder.CreateFAdd(builder.CreateFAdd(builder.CreateFAdd(z_h, z_l), dph), t));
+    llvm::Value *t2 = builder.CreateFSub(z_l, builder.CreateFSub(builder.CreateFSub(builder.CreateFSub(t1, t), dph), z_h));
+
+    // y * log2(x) = p_h + p_l, with y split into y1 + (y - y1).
+    llvm::Value *y1 = clear_low_word(y);
+    p_l = builder.CreateFAdd(builder.CreateFMul(builder.CreateFSub(y, y1), t1), builder.CreateFMul(y, t2));
+    p_h = builder.CreateFMul(y1, t1);
+    llvm::Value *z = builder.CreateFAdd(p_l, p_h);
+    *ordinary = builder.CreateAnd(ordinaryX, builder.CreateAnd(
+        builder.CreateFCmpOLT(fabs(y), number(2147483648.0)), builder.CreateFCmpOLT(fabs(z), number(1020.0))));
+
+    // 2^(p_h + p_l) = 2^m * 2^(p_h - m + p_l), m the integer nearest z.
+    llvm::Value *mf, *m;
+    round(z, &mf, &m);
+    p_h = builder.CreateFSub(p_h, mf);
+    t = clear_low_word(builder.CreateFAdd(p_l, p_h));
+    u = builder.CreateFMul(t, number(lg2_h));
+    v = builder.CreateFAdd(builder.CreateFMul(builder.CreateFSub(p_l, builder.CreateFSub(t, p_h)), number(lg2)),
+                           builder.CreateFMul(t, number(lg2_l)));
+    z = builder.CreateFAdd(u, v);
+    llvm::Value *w = builder.CreateFSub(v, builder.CreateFSub(z, u));
+    t = builder.CreateFMul(z, z);
+    t1 = builder.CreateFSub(z, builder.CreateFMul(t, polynomial(t, {
+        1.66666666666666019037e-01, -2.77777777770155933842e-03, 6.61375632143793436117e-05,
+        -1.65339022054652515390e-06, 4.13813679705723846039e-08})));
+    r = builder.CreateFSub(builder.CreateFDiv(builder.CreateFMul(z, t1), builder.CreateFSub(t1, number(2.0))),
+                           builder.CreateFAdd(w, builder.CreateFMul(z, w)));
+    z = builder.CreateFSub(number(1.0), builder.CreateFSub(r, z));
+    return scale(z, m);
+}
+
+llvm::Function* MathLibrary::function(const std::string &name, llvm::Type *type, unsigned width) {
+    static const std::map<std::string, llvm::Intrinsic::ID> name2Intrinsic = {
+        {"sin", llvm::Intrinsic::sin},
+        {"cos", llvm::Intrinsic::cos},
+        {"exp", llvm::Intrinsic::exp},
+        {"log", llvm::Intrinsic::log},
+        {"pow", llvm::Intrinsic::pow},
+    };
+    auto intrinsic = name2Intrinsic.find(name);
+    if (intrinsic == name2Intrinsic.end()) {
+        throw 1;
+    }
+    std::string symbol = "math." + name + ".v" + std::to_string(width);
+    if (ulps >= 4) {
+        symbol += ".u" + std::to_string(ulps);
+    }
+    if (llvm::Function *existing = module->getFunction(symbol)) {
+        return existing;
+    }
+
+    doubleType = type;
+    integerType = builder.getInt64Ty();
+    if (width > 1) {
+        integerType = llvm::VectorType::getInteger(llvm::cast<llvm::VectorType>(type));
+    }
+    this->width = width;
+    unsigned arguments = name == "pow" ? 2 : 1;
+    std::vector<llvm::Type*> argumentTypes(arguments, type);
+    llvm::FunctionType *functionType = llvm::FunctionType::get(type, argumentTypes, false);
+    llvm::Function *function = llvm::Function::Create(functionType, llvm::Function::InternalLinkage, symbol, module);
+    function->setDoesNotThrow();
+    function->setDoesNotAccessMemory();
+    std::vector<llvm::Value*> values;
+    for (auto &argument : function->args()) {
+        values.push_back(&argument);
+    }
+
+    llvm::LLVMContext &context = module->getContext();
+    llvm::BasicBlock *entryBlock = llvm::BasicBlock::Create(context, "entry", function);
+    llvm::BasicBlock *libmBlock = llvm::BasicBlock::Create(context, "libm", function);
+    llvm::BasicBlock *returnBlock = llvm::BasicBlock::Create(context, "return", function);
+    builder.SetInsertPoint(entryBlock);
+    llvm::Value *ordinary;
+    llvm::Value *result;
+    if (name == "exp") {
+        result = emit_exp(values[0], ulps, &ordinary);
+    } else if (name == "log") {
+        result = emit_log(values[0], ulps, &ordinary);
+    } else if (name == "pow") {
+        result = emit_pow(values[0], values[1], ulps, &ordinary);
+    } else {
+        result = emit_sincos(values[0], name == "cos", ulps, &ordinary);
+    }
+    llvm::Value *all = ordinary;
+    if (width > 1) {
+        all = builder.CreateICmpEQ(builder.CreateBitCast(ordinary, builder.getIntNTy(width)),
+                                   llvm::ConstantInt::getAllOnesValue(builder.getIntNTy(width)));
+    }
+    builder.CreateCondBr(all, returnBlock, libmBlock);
+
+    // Rarely taken: the lanes the vector code isn't valid for call libm.
+    builder.SetInsertPoint(libmBlock);
+    llvm::Function *libm = llvm::Intrinsic::getDeclaration(module, intrinsic->second, {builder.getDoubleTy()});
+    llvm::Value *exact = values[0];
+    if (width > 1) {
+        for (unsigned lane = 0; lane < width; lane++) {
+            std::vector<llvm::Value*> laneArguments;
+            for (auto value : values) {
+                laneArguments.push_back(builder.CreateExtractElement(value, lane));
+            }
+            exact = builder.CreateInsertElement(exact, builder.CreateCall(libm, laneArguments), lane);
+        }
+    } else {
+        exact = builder.CreateCall(libm, values);
+    }
+    llvm::Value *merged = builder.CreateSelect(ordinary, result, exact);
+    builder.CreateBr(returnBlock);
+
+    builder.SetInsertPoint(returnBlock);
+    llvm::PHINode *phi = builder.CreatePHI(type, 2);
+    phi->addIncoming(result, entryBlock);
+    phi->addIncoming(merged, libmBlock);
+    builder.CreateRet(phi);
+    return function;
+}
@@ -0,0 +1,93 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MATHLIBRARY_HPP_
+#define MATHLIBRARY_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+
+/// MathLibrary - sin, cos, exp, log and pow on scalars or on vectors of
+/// doubles, which kernels with the Inline math functions of IRVisitor call
+/// instead of calling libm lane by lane.
+///
+/// The functions are emitted as IR into the module of the kernel using them,
+/// with internal linkage, so the optimizer can inline them into the loop of
+/// a batch kernel, and nothing has to be linked into the JIT. The accurate
+/// variants are within 1 ulp and follow fdlibm. The fast ones evaluate the
+/// shortest Taylor polynomials which keep the error within the given bound.
+/// Since exp(y * log(x)) rounds y * log(x), which can be up to 709, pow
+/// only has a fast variant from a bound of 4096 ulps. For sin and cos the
+/// bound is relative to 1 close to the zeros other than 0.
+///
+/// The vector code handles the arguments for which the result is a normal
+/// number and, for sin and cos, |x| <= 2^20. When a lane is outside this
+/// range, e.g. for a non-finite argument, the function computes that lane
+/// with libm instead. Each lane therefore gets the same result whatever the
+/// other lanes hold.
+class MathLibrary {
+    llvm::Module *module;
+    unsigned ulps;
+    llvm::IRBuilder<> builder;
+    // The types of the function being emitted, double or a vector of them,
+    // and the integer type of the same shape.
+    llvm::Type *doubleType;
+    llvm::Type *integerType;
+    unsigned width;
+
+    llvm::Value* number(double value);
+    llvm::Value* integer(int64_t value);
+    llvm::Value* bits(llvm::Value *value);
+    llvm::Value* real(llvm::Value *bits);
+    llvm::Value* clear_low_word(llvm::Value *value);
+    llvm::Value* fabs(llvm::Value *value);
+    llvm::Value* polynomial(llvm::Value *x, const std::vector<double> &coefficients);
+    void round(llvm::Value *value, llvm::Value **rounded, llvm::Value **integral);
+    llvm::Value* scale(llvm::Value *value, llvm::Value *exponent);
+    // The relative error the polynomials of the fast variants within bound
+    // ulps may have.
+    static double truncation(unsigned bound);
+
+    // Each returns the result of the vector code within bound ulps, and
+    // sets ordinary to the lanes it is valid for.
+    llvm::Value* emit_exp(llvm::Value *x, unsigned bound, llvm::Value **ordinary);
+    llvm::Value* emit_log(llvm::Value *x, unsigned bound, llvm::Value **ordinary);
+    llvm::Value* emit_sincos(llvm::Value *x, bool cosine, unsigned bound, llvm::Value **ordinary);
+    llvm::Value* emit_pow(llvm::Value *x, llvm::Value *y, unsigned bound, llvm::Value **ordinary);
+
+ public:
+    // ulps is the error bound of the fast variants. Bounds under 4 ulps
+    // select the accurate variants.
+    explicit MathLibrary(llvm::Module *module, unsigned ulps = 1);
+
+    // The function computing name, which is "sin", "cos", "exp", "log" or
+    // "pow", on values of type, a double or a vector of width doubles. It is
+    // emitted on first use.
+    llvm::Function* function(const std::string &name, llvm::Type *type, unsigned width);
+};
+
+#endif  // MATHLIBRARY_HPP_
@@ -0,0 +1,137 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <fstream>
+
+#include "ObjectExporter.hpp"
+#include "Func.hpp"
+#include "IRVisitor.hpp"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Object/ArchiveWriter.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+void ObjectExporter::set_target(const std::string &cpu, const std::string &features, unsigned width) {
+    targetCPU = cpu;
+    targetFeatures = features;
+    targetWidth = width > 0 ? width : 1;
+}
+
+void ObjectExporter::add(const std::string &name, const Func &func) {
+    Entry entry;
+    entry.name = name;
+    entry.graph = func.lowered();
+    entry.argumentPlacefolders = func.argumentPlacefolders;
+    entry.width = func.vectorWidth;
+    entry.mathPolicy = func.mathPolicy;
+    entry.mathFunctions = func.mathFunctions;
+    entry.mathErrorBound = func.mathErrorBound;
+    entries.push_back(entry);
+}
+
+void ObjectExporter::compile(llvm::SmallVectorImpl<char> *object) {
+    unsigned defaultWidth = targetCPU == "host" ? IRVisitor::host_vector_width() : targetWidth;
+    IRVisitor* visitor = new IRVisitor();
+    for (auto &entry : entries) {
+        unsigned width = entry.width > 0 ? entry.width : defaultWidth;
+        visitor->set_math_policy(entry.mathPolicy);
+        visitor->set_math_functions(entry.mathFunctions);
+        visitor->set_math_error_bound(entry.mathErrorBound);
+        visitor->create_callee(entry.argumentPlacefolders, entry.name, entry.graph);
+        visitor->create_batch(entry.argumentPlacefolders, entry.name + "_batch", entry.graph, width);
+    }
+    visitor->optimize(optimizationLevel);
+    visitor->create_object(object, optimizationLevel, targetCPU, targetFeatures);
+    delete visitor;
+}
+
+void ObjectExporter::write_object(const std::string &path) {
+    llvm::SmallVector<char, 0> object;
+    compile(&object);
+
+    std::error_code error;
+    llvm::raw_fd_ostream stream(path, error, llvm::sys::fs::OF_None);
+    if (error) {
+        llvm::errs() << path << ": " << error.message() << "\n";
+        throw 1;
+    }
+    stream.write(object.data(), object.size());
+}
+
+void ObjectExporter::write_archive(const std::string &path) {
+    llvm::SmallVector<char, 0> object;
+    compile(&object);
+
+    std::string memberName = llvm::sys::path::stem(path).str() + ".o";
+    std::unique_ptr<llvm::MemoryBuffer> buffer = llvm::MemoryBuffer::getMemBuffer(
+        llvm::StringRef(object.data(), object.size()), memberName, false);
+    std::vector<llvm::NewArchiveMember> members;
+    members.push_back(llvm::NewArchiveMember(buffer->getMemBufferRef()));
+    members.back().MemberName = memberName;
+
+    llvm::Triple triple(llvm::sys::getProcessTriple());
+    auto kind = triple.isOSDarwin() ? llvm::object::Archive::K_DARWIN : llvm::object::Archive::K_GNU;
+    if (llvm::Error error = llvm::writeArchive(path, members, true, kind, true, false)) {
+        llvm::errs() << path << ": " << llvm::toString(std::move(error)) << "\n";
+        throw 1;
+    }
+}
+
+void ObjectExporter::write_header(const std::string &path) {
+    std::string guard = llvm::sys::path::filename(path).str();
+    for (auto &c : guard) {
+        c = isalnum(static_cast<unsigned char>(c)) ? toupper(static_cast<unsigned char>(c)) : '_';
+    }
+    guard += "_";
+
+    std::ofstream stream(path);
+    if (!stream) {
+        throw 1;
+    }
+    stream << "// Generated by ObjectExporter. Do not edit.\n\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n\n"
+        << "#include <stdint.h>\n\n"
+        << "#ifdef __cplusplus\n"
+        << "extern \"C\" {\n"
+        << "#endif\n\n";
+    for (auto &entry : entries) {
+        stream << "double " << entry.name << "(";
+        for (size_t i = 0; i < entry.argumentPlacefolders.size(); i++) {
+            stream << (i > 0 ? ", " : "") << "double " << entry.argumentPlacefolders[i].name;
+        }
+        if (entry.argumentPlacefolders.empty()) {
+            stream << "void";
+        }
+        stream << ");\n";
+        stream << "void " << entry.name << "_batch(const double *const *columns, int64_t rows, double *out);\n\n";
+    }
+    stream << "#ifdef __cplusplus\n"
+        << "}  // extern \"C\"\n"
+        << "#endif\n\n"
+        << "#endif  // " << guard << "\n";
+}
@@ -0,0 +1,83 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef OBJECTEXPORTER_HPP_
+#define OBJECTEXPORTER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "Graph.hpp"
+#include "IRVisitor.hpp"
+#include "Var.hpp"
+
+class Func;
+
+/// ObjectExporter - Compiles a set of Funcs ahead of time into a native
+/// object file or static library, with a C header declaring them.
+///
+/// Every Func added as name is exported with this ABI:
+///
+///   double name(double arg0, double arg1, ...);
+///   void name_batch(const double *const *columns, int64_t rows, double *out);
+///
+/// name_batch is the same structure-of-arrays kernel as Func::evaluate, so
+/// code written against the JIT can call the exported functions unchanged.
+/// The code is generated for the generic CPU of the host triple, so the
+/// object runs on any machine of that architecture; set_target picks a
+/// specific CPU, or "host" to match the JIT.
+class ObjectExporter {
+    struct Entry {
+        std::string name;
+        Graph graph;
+        std::vector<Var> argumentPlacefolders;
+        unsigned width;
+        IRVisitor::MathPolicy mathPolicy;
+        IRVisitor::MathFunctions mathFunctions;
+        unsigned mathErrorBound;
+    };
+    std::vector<Entry> entries;
+    unsigned optimizationLevel;
+    std::string targetCPU;
+    std::string targetFeatures;
+    unsigned targetWidth;
+
+    void compile(llvm::SmallVectorImpl<char> *object);
+
+ public:
+    explicit ObjectExporter(unsigned optimizationLevel = 2)
+        : optimizationLevel(optimizationLevel), targetCPU("generic"), targetWidth(2) {}
+
+    // Generate code for cpu with the comma separated features, such as
+    // "+avx2,+fma". Funcs without a vector width of their own are
+    // vectorized by width, or by the host's width when cpu is "host".
+    void set_target(const std::string &cpu, const std::string &features, unsigned width);
+
+    void add(const std::string &name, const Func &func);
+
+    void write_object(const std::string &path);
+    void write_archive(const std::string &path);
+    void write_header(const std::string &path);
+};
+
+#endif  // OBJECTEXPORTER_HPP_
@@ -0,0 +1,51 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef PARAM_HPP_
+#define PARAM_HPP_
+
+#include <string>
+#include <memory>
+
+#include "Expr.hpp"
+#include "ExprAST.hpp"
+
+/// Param - A named scalar which a compiled Func reads at run time, so that
+/// its value can be changed with Func::set_param without compiling again.
+/// value is the value it starts with.
+class Param {
+ public:
+    static int name_count;
+    std::string name;
+    double value;
+ public:
+    explicit Param(double value = 0) : value(value) {
+        name = "param" + std::to_string(name_count++);
+    }
+    Param(std::string name, double value) : name(name), value(value) {}
+    operator Expr() const {
+        return make_expr<ParamExprAST>(name, value);
+    }
+};
+
+#endif  // PARAM_HPP_
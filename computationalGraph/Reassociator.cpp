@@ -0,0 +1,184 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+#include "Reassociator.hpp"
+
+Reassociator::Reassociator(Strategy strategy, unsigned accumulators)
+    : strategy(strategy), accumulators(accumulators) {
+    if (accumulators == 0) {
+        throw 1;
+    }
+}
+
+int Reassociator::combine(Graph *result, std::vector<int> *heights, Graph::Opcode opcode, const std::vector<int> &leaves) const {
+    auto operation = [&](int a, int b) {
+        int index = result->operation(opcode, a, b);
+        if (index >= static_cast<int>(heights->size())) {
+            heights->resize(index + 1, 0);
+        }
+        (*heights)[index] = std::max((*heights)[a], (*heights)[b]) + 1;
+        return index;
+    };
+    // Combine neighbours until one is left.
+    auto pairwise = [&](std::vector<int> level) {
+        while (level.size() > 1) {
+            size_t half = 0;
+            for (size_t k = 0; k + 1 < level.size(); k += 2) {
+                level[half++] = operation(level[k], level[k + 1]);
+            }
+            if (level.size() % 2 == 1) {
+                level[half++] = level.back();
+            }
+            level.resize(half);
+        }
+        return level[0];
+    };
+
+    switch (strategy) {
+    case Balanced: {
+        // Ordered by height, then by position, so that the result doesn't
+        // depend on how the queue breaks ties.
+        typedef std::pair<int, size_t> Entry;
+        std::priority_queue<std::pair<Entry, int>, std::vector<std::pair<Entry, int>>,
+            std::greater<std::pair<Entry, int>>> ready;
+        size_t position = 0;
+        for (int leaf : leaves) {
+            ready.push(std::make_pair(std::make_pair((*heights)[leaf], position++), leaf));
+        }
+        while (ready.size() > 1) {
+            int a = ready.top().second;
+            ready.pop();
+            int b = ready.top().second;
+            ready.pop();
+            int index = operation(a, b);
+            ready.push(std::make_pair(std::make_pair((*heights)[index], position++), index));
+        }
+        return ready.top().second;
+    }
+    case Accumulators: {
+        std::vector<int> partial;
+        for (size_t k = 0; k < leaves.size(); k++) {
+            if (k < accumulators) {
+                partial.push_back(leaves[k]);
+            } else {
+                partial[k % accumulators] = operation(partial[k % accumulators], leaves[k]);
+            }
+        }
+        return pairwise(partial);
+    }
+    default:
+        return pairwise(leaves);
+    }
+}
+
+Graph Reassociator::run(const Graph &graph) const {
+    if (strategy == None) {
+        return graph;
+    }
+    // The number of uses of each node, and its last user.
+    std::vector<int> uses(graph.size(), 0);
+    std::vector<int> user(graph.size(), -1);
+    for (size_t i = 0; i < graph.size(); i++) {
+        const Graph::Node &node = graph[i];
+        int operands = Graph::arity(node.opcode);
+        if (operands > 0) {
+            uses[node.a]++;
+            user[node.a] = static_cast<int>(i);
+        }
+        if (operands > 1) {
+            uses[node.b]++;
+            user[node.b] = static_cast<int>(i);
+        }
+    }
+    for (int output : graph.outputs()) {
+        uses[output]++;
+        user[output] = -1;
+    }
+    // Whether a node is inside a chain, being used only by the same
+    // associative operation, which takes its leaves over.
+    auto inner = [&](int index) {
+        Graph::Opcode opcode = graph[index].opcode;
+        return Graph::is_commutative(opcode) && uses[index] == 1 && user[index] >= 0
+            && graph[user[index]].opcode == opcode;
+    };
+
+    Graph result(graph.arguments());
+    // The depth of each node of result, leaves being 0.
+    std::vector<int> heights;
+    // The node of result each node of graph became.
+    std::vector<int> rebuilt(graph.size(), -1);
+    std::vector<int> leaves;
+    std::vector<int> stack;
+    for (size_t i = 0; i < graph.size(); i++) {
+        const Graph::Node &node = graph[i];
+        int index;
+        switch (node.opcode) {
+        case Graph::Argument:
+            index = result.argument(node.a);
+            break;
+        case Graph::Parameter:
+            index = result.parameter(graph.parameter_name(node.a), graph.parameter_value(node.a));
+            break;
+        case Graph::Constant:
+            index = result.constant(node.constant);
+            break;
+        case Graph::Add:
+        case Graph::Multiply:
+            if (inner(static_cast<int>(i))) {
+                continue;
+            }
+            // Collect the leaves from left to right.
+            leaves.clear();
+            stack.assign(1, static_cast<int>(i));
+            while (!stack.empty()) {
+                int top = stack.back();
+                stack.pop_back();
+                if (top == static_cast<int>(i) || inner(top)) {
+                    stack.push_back(graph[top].b);
+                    stack.push_back(graph[top].a);
+                } else {
+                    leaves.push_back(rebuilt[top]);
+                }
+            }
+            index = combine(&result, &heights, node.opcode, leaves);
+            break;
+        default:
+            index = result.operation(node.opcode, rebuilt[node.a], node.b >= 0 ? rebuilt[node.b] : -1);
+            heights.resize(result.size(), 0);
+            heights[index] = heights[rebuilt[node.a]] + 1;
+            if (node.b >= 0) {
+                heights[index] = std::max(heights[index], heights[rebuilt[node.b]] + 1);
+            }
+            break;
+        }
+        heights.resize(result.size(), 0);
+        rebuilt[i] = index;
+    }
+    for (int output : graph.outputs()) {
+        result.add_output(rebuilt[output]);
+    }
+    return result;
+}
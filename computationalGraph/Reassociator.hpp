@@ -0,0 +1,68 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef REASSOCIATOR_HPP_
+#define REASSOCIATOR_HPP_
+
+#include "Graph.hpp"
+
+/// Reassociator - Rebuilds the chains of + and of * in a Graph, such as the
+/// left-deep sums operator+ makes, so that their operations don't all wait
+/// on each other.
+///
+/// A chain is a maximal tree of one associative operation whose inner nodes
+/// have no other user, so a shared partial sum is kept as it is. Its leaves
+/// are combined again in the way the strategy picks, which changes how the
+/// result is rounded. Sums of n terms are the case it is made for:
+///
+///   Pairwise      adds neighbouring terms, then neighbouring pairs, and so
+///                 on. The rounding error grows with log n instead of n.
+///   Balanced      always combines the two operands which are ready first,
+///                 which gives the shortest critical path, also when the
+///                 terms themselves have different depths.
+///   Accumulators  adds the terms round robin into k partial sums, which are
+///                 then added pairwise. Its depth is about n / k, which is
+///                 enough to keep k adders busy with fewer live registers.
+///
+/// The leaves are taken in the order the chain holds them, which is not the
+/// order of the source expression: the Simplifier has already ordered the
+/// operands of + and * by their hash. No strategy keeps the source order.
+class Reassociator {
+ public:
+    enum Strategy { None, Pairwise, Balanced, Accumulators };
+
+ private:
+    Strategy strategy;
+    unsigned accumulators;
+
+    // Combine the leaves of one chain in result, whose node depths are in heights.
+    int combine(Graph *result, std::vector<int> *heights, Graph::Opcode opcode, const std::vector<int> &leaves) const;
+
+ public:
+    explicit Reassociator(Strategy strategy = None, unsigned accumulators = 4);
+
+    // graph with its chains rebuilt. None returns it unchanged.
+    Graph run(const Graph &graph) const;
+};
+
+#endif  // REASSOCIATOR_HPP_
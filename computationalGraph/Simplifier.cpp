@@ -0,0 +1,148 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <cmath>
+#include <utility>
+
+#include "Simplifier.hpp"
+
+Simplifier::Simplifier(unsigned arguments) : arguments(arguments) {
+}
+
+void Simplifier::bind(int slot, double value) {
+    if (slot < 0 || slot >= static_cast<int>(arguments)) {
+        throw 1;
+    }
+    slot2Value[slot] = value;
+}
+
+Graph Simplifier::run(const Graph &graph) const {
+    if (graph.arguments() != arguments) {
+        throw 1;
+    }
+    // The slot of each argument in the result.
+    std::vector<int> slots(arguments, -1);
+    int remaining = 0;
+    for (int k = 0; k < static_cast<int>(arguments); k++) {
+        if (slot2Value.count(k) == 0) {
+            slots[k] = remaining++;
+        }
+    }
+
+    Graph result(remaining);
+    ExprHasher hasher(false);
+    // Whether left and right of a commutative operation are in canonical order.
+    auto ordered = [&](int left, int right) {
+        double value;
+        bool leftNumber = result.is_constant(left, &value);
+        bool rightNumber = result.is_constant(right, &value);
+        if (leftNumber != rightNumber) {
+            return rightNumber;
+        }
+        hasher.update(result);
+        return hasher.hash(left) <= hasher.hash(right);
+    };
+
+    // The node of result each node of graph became.
+    std::vector<int> simplified(graph.size(), -1);
+    for (size_t i = 0; i < graph.size(); i++) {
+        const Graph::Node &node = graph[i];
+        if (node.opcode == Graph::Argument) {
+            auto bound = slot2Value.find(node.a);
+            simplified[i] = bound != slot2Value.end() ? result.constant(bound->second) : result.argument(slots[node.a]);
+            continue;
+        }
+        if (node.opcode == Graph::Parameter) {
+            simplified[i] = result.parameter(graph.parameter_name(node.a), graph.parameter_value(node.a));
+            continue;
+        }
+        if (node.opcode == Graph::Constant) {
+            simplified[i] = result.constant(node.constant);
+            continue;
+        }
+
+        int left = simplified[node.a];
+        int right = Graph::arity(node.opcode) > 1 ? simplified[node.b] : -1;
+        double a, b;
+        bool leftNumber = result.is_constant(left, &a);
+        bool rightNumber = right >= 0 && result.is_constant(right, &b);
+        int folded = -1;
+        switch (node.opcode) {
+        case Graph::Add:
+            if (leftNumber && rightNumber) {
+                folded = result.constant(a + b);
+            } else if (rightNumber && b == 0) {
+                folded = left;
+            } else if (leftNumber && a == 0) {
+                folded = right;
+            }
+            break;
+        case Graph::Multiply:
+            if (leftNumber && rightNumber) {
+                folded = result.constant(a * b);
+            } else if (rightNumber && b == 1) {
+                folded = left;
+            } else if (leftNumber && a == 1) {
+                folded = right;
+            }
+            break;
+        case Graph::Divide:
+            if (leftNumber && rightNumber) {
+                folded = result.constant(a / b);
+            } else if (rightNumber && b == 1) {
+                folded = left;
+            }
+            break;
+        case Graph::Sine:
+            if (leftNumber) {
+                folded = result.constant(std::sin(a));
+            }
+            break;
+        case Graph::Power:
+            if (leftNumber && rightNumber) {
+                folded = result.constant(std::pow(a, b));
+            } else if (rightNumber && b == 1) {
+                folded = left;
+            } else if (rightNumber && b == 0) {
+                // pow(x, 0) is 1 for every x, even NaN.
+                folded = result.constant(1.0);
+            }
+            break;
+        default:
+            break;
+        }
+        if (folded >= 0) {
+            simplified[i] = folded;
+            continue;
+        }
+
+        if (Graph::is_commutative(node.opcode) && !ordered(left, right)) {
+            std::swap(left, right);
+        }
+        simplified[i] = result.operation(node.opcode, left, right);
+    }
+    for (int output : graph.outputs()) {
+        result.add_output(simplified[output]);
+    }
+    return result.prune();
+}
@@ -0,0 +1,59 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef SIMPLIFIER_HPP_
+#define SIMPLIFIER_HPP_
+
+#include <map>
+#include <vector>
+
+#include "Graph.hpp"
+#include "KernelCache.hpp"
+
+/// Simplifier - Rewrites a Graph into a smaller equivalent one before code
+/// is generated for it, in one forward scan.
+///
+/// It folds subtrees of constants, removes the identities x + 0, x * 1,
+/// x / 1, pow(x, 1) and pow(x, 0), and puts the operands of + and * into
+/// a canonical order: constants last, the rest by structural hash. Only
+/// rewrites which keep every result are made, up to the sign of zero for
+/// x + 0, so e.g. x * 0 is kept, being NaN for infinite x. The original
+/// graph is left untouched and shared subtrees stay shared.
+class Simplifier {
+    unsigned arguments;
+    // Argument slots replaced by constants.
+    std::map<int, double> slot2Value;
+
+ public:
+    explicit Simplifier(unsigned arguments);
+
+    // Substitute value for the argument slot wherever it occurs, so that
+    // the subtrees depending only on bound arguments fold away. The bound
+    // arguments are removed, and the remaining ones keep their order.
+    void bind(int slot, double value);
+
+    // The simplified graph, without the nodes its outputs don't depend on.
+    Graph run(const Graph &graph) const;
+};
+
+#endif  // SIMPLIFIER_HPP_
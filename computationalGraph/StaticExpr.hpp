@@ -0,0 +1,205 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef STATICEXPR_HPP_
+#define STATICEXPR_HPP_
+
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+#include "Expr.hpp"
+#include "ExprAST.hpp"
+#include "Var.hpp"
+
+// Compile-time expressions: a formula whose structure is known when the
+// program is compiled is encoded in its C++ type instead of in a graph.
+//
+//   StaticVar<0> a;
+//   StaticVar<1> b;
+//   auto f = F::sin(a * b) + F::pow(a, 2.0) / b;
+//   double y = f(0.5, 2.0);    // plain inlined C++, no allocation
+//
+//   Func g;
+//   Var x, z;
+//   g(x, z) = f.expr({x, z});  // the same formula as an ExprAST, to JIT
+//
+// Evaluation is constexpr, so with constant arguments + * / fold at compile
+// time; sin and pow do where the compiler treats them as builtins.
+
+// Picks the argument at Index of a pack.
+template <int Index>
+struct StaticArgument {
+    template <typename First, typename... Rest>
+    static constexpr double get(First first, Rest... rest) {
+        return StaticArgument<Index - 1>::get(rest...);
+    }
+};
+
+template <>
+struct StaticArgument<0> {
+    template <typename First, typename... Rest>
+    static constexpr double get(First first, Rest... /*rest*/) {
+        return first;
+    }
+};
+
+/// StaticVar - The argument at Index, like Var.
+template <int Index>
+struct StaticVar : StaticExprTag {
+    constexpr StaticVar() {}
+
+    template <typename... Args>
+    constexpr double operator()(Args... args) const {
+        static_assert(Index < sizeof...(Args), "too few arguments for the expression");
+        return StaticArgument<Index>::get(static_cast<double>(args)...);
+    }
+
+    Expr expr(const std::vector<Var> &vars) const {
+        return vars.at(Index);
+    }
+};
+
+/// StaticNumber - A constant, like NumberExprAST.
+struct StaticNumber : StaticExprTag {
+    double value;
+
+    constexpr explicit StaticNumber(double value) : value(value) {}
+
+    template <typename... Args>
+    constexpr double operator()(Args... /*args*/) const {
+        return value;
+    }
+
+    Expr expr(const std::vector<Var> &/*vars*/) const {
+        return Expr(value);
+    }
+};
+
+/// StaticBinary - A binary operator, like BinaryExprAST.
+template <char Op, typename L, typename R>
+struct StaticBinary : StaticExprTag {
+    L lhs;
+    R rhs;
+
+    constexpr StaticBinary(const L &lhs, const R &rhs) : lhs(lhs), rhs(rhs) {}
+
+    template <typename... Args>
+    constexpr double operator()(Args... args) const {
+        return Op == '+' ? lhs(args...) + rhs(args...)
+            : Op == '*' ? lhs(args...) * rhs(args...)
+            : lhs(args...) / rhs(args...);
+    }
+
+    Expr expr(const std::vector<Var> &vars) const {
+        return make_expr<BinaryExprAST>(Op, lhs.expr(vars), rhs.expr(vars));
+    }
+};
+
+/// StaticSin - sin, like Sin.
+template <typename A>
+struct StaticSin : StaticExprTag {
+    A arg;
+
+    constexpr explicit StaticSin(const A &arg) : arg(arg) {}
+
+    template <typename... Args>
+    constexpr double operator()(Args... args) const {
+        return std::sin(arg(args...));
+    }
+
+    Expr expr(const std::vector<Var> &vars) const {
+        return make_expr<Sin>(arg.expr(vars));
+    }
+};
+
+/// StaticPow - pow, like Pow.
+template <typename A, typename B>
+struct StaticPow : StaticExprTag {
+    A a;
+    B b;
+
+    constexpr StaticPow(const A &a, const B &b) : a(a), b(b) {}
+
+    template <typename... Args>
+    constexpr double operator()(Args... args) const {
+        return std::pow(a(args...), b(args...));
+    }
+
+    Expr expr(const std::vector<Var> &vars) const {
+        return make_expr<Pow>(a.expr(vars), b.expr(vars));
+    }
+};
+
+// Operands of compile-time expressions: themselves, or numbers.
+template <typename T, bool = std::is_base_of<StaticExprTag, T>::value>
+struct StaticOperand {
+    typedef T type;
+    static constexpr const T& make(const T &operand) { return operand; }
+};
+
+template <typename T>
+struct StaticOperand<T, false> {
+    static_assert(std::is_arithmetic<T>::value, "only numbers mix with compile-time expressions");
+    typedef StaticNumber type;
+    static constexpr StaticNumber make(T operand) { return StaticNumber(static_cast<double>(operand)); }
+};
+
+// At least one side is a compile-time expression, and the other one a
+// compile-time expression or a number, so that Expr keeps its operators.
+template <typename L, typename R>
+using EnableStatic = typename std::enable_if<
+    (std::is_base_of<StaticExprTag, L>::value && (std::is_base_of<StaticExprTag, R>::value || std::is_arithmetic<R>::value))
+    || (std::is_arithmetic<L>::value && std::is_base_of<StaticExprTag, R>::value), int>::type;
+
+template <typename L, typename R, EnableStatic<L, R> = 0>
+constexpr StaticBinary<'+', typename StaticOperand<L>::type, typename StaticOperand<R>::type> operator+ (const L &lhs, const R &rhs) {
+    return StaticBinary<'+', typename StaticOperand<L>::type, typename StaticOperand<R>::type>(
+        StaticOperand<L>::make(lhs), StaticOperand<R>::make(rhs));
+}
+
+template <typename L, typename R, EnableStatic<L, R> = 0>
+constexpr StaticBinary<'*', typename StaticOperand<L>::type, typename StaticOperand<R>::type> operator* (const L &lhs, const R &rhs) {
+    return StaticBinary<'*', typename StaticOperand<L>::type, typename StaticOperand<R>::type>(
+        StaticOperand<L>::make(lhs), StaticOperand<R>::make(rhs));
+}
+
+template <typename L, typename R, EnableStatic<L, R> = 0>
+constexpr StaticBinary<'/', typename StaticOperand<L>::type, typename StaticOperand<R>::type> operator/ (const L &lhs, const R &rhs) {
+    return StaticBinary<'/', typename StaticOperand<L>::type, typename StaticOperand<R>::type>(
+        StaticOperand<L>::make(lhs), StaticOperand<R>::make(rhs));
+}
+
+// Reached through F::sin and F::pow.
+template <typename A>
+constexpr StaticSin<A> static_sin(const A &a) {
+    return StaticSin<A>(a);
+}
+
+template <typename A, typename B, EnableStatic<A, B> = 0>
+constexpr StaticPow<typename StaticOperand<A>::type, typename StaticOperand<B>::type> static_pow(const A &a, const B &b) {
+    return StaticPow<typename StaticOperand<A>::type, typename StaticOperand<B>::type>(
+        StaticOperand<A>::make(a), StaticOperand<B>::make(b));
+}
+
+#endif  // STATICEXPR_HPP_
@@ -0,0 +1,171 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        unsigned hardware = std::thread::hardware_concurrency();
+        threads = hardware > 1 ? hardware - 1 : 0;
+    }
+    pending = 0;
+    stopping = false;
+    for (unsigned i = 0; i < std::max(threads, 1u); i++) {
+        queues.emplace_back(new Queue());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+// Take the most recently queued chunk of a worker's own deque, whose data
+// is the most likely to still be in its cache.
+bool ThreadPool::take(unsigned queue, Chunk *chunk) {
+    Queue &own = *queues[queue];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.chunks.empty()) {
+        return false;
+    }
+    *chunk = own.chunks.back();
+    own.chunks.pop_back();
+    pending--;
+    return true;
+}
+
+// Take the oldest chunk of any deque, starting the search at first.
+bool ThreadPool::steal(unsigned first, Chunk *chunk) {
+    for (unsigned i = 0; i < queues.size(); i++) {
+        Queue &victim = *queues[(first + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.chunks.empty()) {
+            *chunk = victim.chunks.front();
+            victim.chunks.pop_front();
+            pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(const Chunk &chunk) {
+    Job *job = chunk.job;
+    std::exception_ptr error;
+    if (!job->failed) {
+        try {
+            (*job->body)(chunk.begin, chunk.end);
+        } catch (...) {
+            error = std::current_exception();
+            job->failed = true;
+        }
+    }
+    // Count down under the lock, so that the waiting thread can't see the
+    // job finished and destroy it while it is still being notified. A chunk
+    // that threw is still counted, or the waiting thread would never wake.
+    std::lock_guard<std::mutex> lock(job->mutex);
+    if (error && !job->error) {
+        job->error = error;
+    }
+    if (--job->remaining == 0) {
+        job->done.notify_all();
+    }
+}
+
+void ThreadPool::work(unsigned index) {
+    Chunk chunk;
+    while (true) {
+        if (take(index, &chunk) || steal(index + 1, &chunk)) {
+            run(chunk);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || pending > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int64_t count, int64_t grain, const std::function<void(int64_t begin, int64_t end)> &body) {
+    if (count <= 0) {
+        return;
+    }
+    grain = std::max<int64_t>(grain, 1);
+    int64_t chunks = (count + grain - 1) / grain;
+    // Not worth waking anybody for.
+    if (chunks == 1 || workers.empty()) {
+        body(0, count);
+        return;
+    }
+
+    Job job;
+    job.body = &body;
+    job.remaining = chunks;
+    job.failed = false;
+
+    // Deal contiguous runs of chunks to the deques, so that a worker which
+    // doesn't have to steal walks through memory in order.
+    int64_t perQueue = (chunks + queues.size() - 1) / queues.size();
+    for (unsigned q = 0; q < queues.size(); q++) {
+        Queue &queue = *queues[q];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (int64_t c = q * perQueue; c < std::min(chunks, (q + 1) * perQueue); c++) {
+            // Pushed to the front, so that the owner's back is the first chunk.
+            queue.chunks.push_front(Chunk{&job, c * grain, std::min(count, (c + 1) * grain)});
+            pending++;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+
+    // Help until there is nothing left to take, then wait for the chunks
+    // still running on the workers.
+    Chunk chunk;
+    while (job.remaining > 0 && steal(0, &chunk)) {
+        run(chunk);
+    }
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.done.wait(lock, [&job]() { return job.remaining == 0; });
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
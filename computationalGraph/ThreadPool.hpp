@@ -0,0 +1,96 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// ThreadPool - Worker threads with one work-stealing deque each.
+///
+/// parallel_for splits a range into chunks and deals them out over the
+/// deques. A worker takes chunks from the back of its own deque and, once
+/// that is empty, steals from the front of the others. The calling thread
+/// works on the chunks as well until all of them are done.
+class ThreadPool {
+    struct Job {
+        const std::function<void(int64_t, int64_t)> *body;
+        std::atomic<int64_t> remaining;
+        // Set once a chunk has thrown; the chunks left are then skipped.
+        std::atomic<bool> failed;
+        // The first exception thrown by a chunk, guarded by mutex.
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    struct Chunk {
+        Job *job;
+        int64_t begin;
+        int64_t end;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    // Chunks queued and not yet taken, so that idle workers know when to sleep.
+    std::atomic<int64_t> pending;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    bool take(unsigned queue, Chunk *chunk);
+    bool steal(unsigned first, Chunk *chunk);
+    void run(const Chunk &chunk);
+    void work(unsigned index);
+
+ public:
+    // threads is the number of workers besides the calling thread. 0 uses
+    // one less than the number of hardware threads.
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    // The pool used by Func, created on first use.
+    static ThreadPool& shared();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // Call body(begin, end) on disjoint chunks of [0, count) of at most
+    // grain elements, and return once every chunk is done. Chunk c starts
+    // at c * grain. If a chunk throws, the chunks not yet started are
+    // skipped and the first exception is rethrown once all are accounted for.
+    void parallel_for(int64_t count, int64_t grain, const std::function<void(int64_t begin, int64_t end)> &body);
+};
+
+#endif  // THREADPOOL_HPP_
@@ -44,8 +44,7 @@ class Var {
     }
     operator Expr() const {
         if (value == nullptr) {
-            std::shared_ptr<ExprAST> p(new VarExprAST(name));
-            return Expr(p);
+            return make_expr<VarExprAST>(name);
         } else {
             return Expr(value);
         }
@@ -0,0 +1,81 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef CHECK_HPP_
+#define CHECK_HPP_
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// Checks for the tests, which report every failure instead of stopping at
+// the first one. A test returns check_result() from main.
+static int checkFailures = 0;
+
+static bool check_report(bool passed, const char *file, int line, const char *text) {
+    if (!passed) {
+        std::cerr << file << ":" << line << ": failed: " << text << std::endl;
+        checkFailures++;
+    }
+    return passed;
+}
+
+// Whether a and b are the same double, counting every NaN as the same.
+static bool same_double(double a, double b) {
+    if (std::isnan(a) || std::isnan(b)) {
+        return std::isnan(a) && std::isnan(b);
+    }
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// Whether a and b differ by at most tolerance relative to the larger.
+static bool close_double(double a, double b, double tolerance) {
+    return std::fabs(a - b) <= tolerance * std::fmax(1.0, std::fmax(std::fabs(a), std::fabs(b)));
+}
+
+static int check_result() {
+    if (checkFailures > 0) {
+        std::cerr << checkFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#define CHECK(condition) check_report((condition), __FILE__, __LINE__, #condition)
+
+#define CHECK_SAME(a, b) check_report(same_double((a), (b)), __FILE__, __LINE__, #a " == " #b)
+
+#define CHECK_CLOSE(a, b, tolerance) \
+    check_report(close_double((a), (b), (tolerance)), __FILE__, __LINE__, #a " close to " #b)
+
+#define CHECK_THROWS(statement) do { \
+        bool thrown = false; \
+        try { \
+            statement; \
+        } catch (...) { \
+            thrown = true; \
+        } \
+        check_report(thrown, __FILE__, __LINE__, #statement " throws"); \
+    } while (0)
+
+#endif  // CHECK_HPP_
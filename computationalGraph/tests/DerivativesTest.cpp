@@ -0,0 +1,148 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "Check.hpp"
+#include "Func.hpp"
+#include "Jacobian.hpp"
+#include "Var.hpp"
+
+// The central difference of f along argument k at point, with a step
+// relative to the argument.
+static double difference(const std::function<double(const std::vector<double>&)> &f,
+                         std::vector<double> point, size_t k) {
+    double step = 1e-6 * std::fmax(1.0, std::fabs(point[k]));
+    double at = point[k];
+    point[k] = at + step;
+    double above = f(point);
+    point[k] = at - step;
+    double below = f(point);
+    return (above - below) / (2 * step);
+}
+
+static std::vector<std::vector<double>> random_points(size_t count, size_t arguments, unsigned seed) {
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> distribution(0.2, 2.5);
+    std::vector<std::vector<double>> points(count, std::vector<double>(arguments));
+    for (auto &point : points) {
+        for (auto &value : point) {
+            value = distribution(random);
+        }
+    }
+    return points;
+}
+
+// The reverse-mode gradient agrees with finite differences of the value,
+// for single points and for batches, and its value is the Func's.
+static void test_gradient() {
+    Var a, b, c;
+    Func f;
+    f(a, b, c) = F::sin(a * b) + F::pow(a, b) / c + F::pow(c, 3.0) * a + F::sin(F::sin(c));
+    f.set_vector_width(4);
+    f.realise_with_gradient();
+    auto value = [&f](const std::vector<double> &point) { return f(point.data()); };
+
+    auto points = random_points(23, 3, 5);
+    std::vector<std::vector<double>> columns(3);
+    for (auto &point : points) {
+        std::vector<double> gradient = f.gradient(point);
+        CHECK_SAME(gradient[0], f(point.data()));
+        for (size_t k = 0; k < 3; k++) {
+            CHECK_CLOSE(gradient[1 + k], difference(value, point, k), 1e-6);
+            columns[k].push_back(point[k]);
+        }
+    }
+
+    // The batch kernel, whose 23 rows leave a scalar remainder, agrees with
+    // the single point one.
+    std::vector<std::vector<double>> out(4, std::vector<double>(points.size()));
+    f.evaluate_gradient({columns[0].data(), columns[1].data(), columns[2].data()}, points.size(),
+                        {out[0].data(), out[1].data(), out[2].data(), out[3].data()});
+    for (size_t i = 0; i < points.size(); i++) {
+        std::vector<double> gradient = f.gradient(points[i]);
+        for (size_t k = 0; k < 4; k++) {
+            CHECK_CLOSE(out[k][i], gradient[k], 1e-14);
+        }
+    }
+
+    // A Func realised without the gradient has none.
+    Func g;
+    g(a) = a * a;
+    g.realise();
+    CHECK_THROWS(g.gradient({1.0}));
+}
+
+// An argument which the expression doesn't use has a zero derivative.
+static void test_unused_argument() {
+    Var a, b;
+    Func f;
+    f(a, b) = F::sin(a) * 2.0;
+    f.realise_with_gradient();
+    std::vector<double> gradient = f.gradient({0.5, 7.0});
+    CHECK_SAME(gradient[1], 2.0 * std::cos(0.5));
+    CHECK_SAME(gradient[2], 0.0);
+}
+
+// The forward-mode Jacobian stores the entries of the arguments each output
+// depends on, and they agree with finite differences of the outputs.
+static void test_jacobian() {
+    Var a, b, c;
+    std::vector<Expr> outputs = {F::sin(a * b), a / b + c, F::pow(c, 2.5), Expr(4.0)};
+    Jacobian jacobian;
+    jacobian(a, b, c) = outputs;
+    jacobian.set_vector_width(2);
+    jacobian.realise();
+
+    std::vector<std::pair<int, int>> expected = {{0, 0}, {0, 1}, {1, 0}, {1, 1}, {1, 2}, {2, 2}};
+    CHECK(jacobian.sparsity() == expected);
+
+    std::vector<Func> funcs(outputs.size());
+    for (size_t j = 0; j < outputs.size(); j++) {
+        funcs[j](a, b, c) = outputs[j];
+        funcs[j].realise();
+    }
+    for (auto &point : random_points(11, 3, 7)) {
+        double values[4];
+        double entries[6];
+        jacobian(point, values, entries);
+        for (size_t j = 0; j < outputs.size(); j++) {
+            CHECK_SAME(values[j], funcs[j](point.data()));
+        }
+        for (size_t e = 0; e < expected.size(); e++) {
+            Func &output = funcs[expected[e].first];
+            auto value = [&output](const std::vector<double> &at) { return output(at.data()); };
+            CHECK_CLOSE(entries[e], difference(value, point, expected[e].second), 1e-6);
+        }
+    }
+}
+
+int main() {
+    test_gradient();
+    test_unused_argument();
+    test_jacobian();
+    return check_result();
+}
@@ -0,0 +1,140 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+#include "Func.hpp"
+#include "Graph.hpp"
+#include "Interpreter.hpp"
+#include "Var.hpp"
+
+static void define(Func *f) {
+    Var a, b, c;
+    (*f)(a, b, c) = F::pow(a, b) * 0.5 + F::sin(a / c) + F::pow(b, 2.0) + F::pow(c, -3.0) / (a + 1.0);
+}
+
+// Arguments which exercise the special cases of pow, sin and division as
+// well as ordinary values.
+static std::vector<std::vector<double>> arguments() {
+    const double infinity = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<std::vector<double>> points = {
+        {0.0, 0.0, 1.0}, {-0.0, 3.0, -2.0}, {-2.0, 3.0, 0.5}, {-2.0, 0.5, 1.0},
+        {1.0, infinity, 0.0}, {infinity, -1.0, 2.0}, {nan, 1.0, 1.0}, {2.0, nan, 3.0},
+        {1e300, 2.0, 1e-300}, {4.9e-324, 0.5, 7.0}, {1e6, 1.5, 1e-6},
+    };
+    std::mt19937_64 random(3);
+    std::uniform_real_distribution<double> distribution(-10.0, 10.0);
+    for (int i = 0; i < 500; i++) {
+        points.push_back({distribution(random), distribution(random), distribution(random)});
+    }
+    return points;
+}
+
+// The Interpreter evaluates a Graph like the C++ expression.
+static void test_interpreter() {
+    Var x, y;
+    Graph graph({x, y}, {F::sin(x) * y + F::pow(x, y) / 3.0});
+    Interpreter interpreter(graph);
+    double point[] = {0.7, 2.5};
+    CHECK_SAME(interpreter.evaluate(point), std::sin(0.7) * 2.5 + std::pow(0.7, 2.5) / 3.0);
+
+    std::vector<double> xs = {0.1, 0.2, 0.3}, ys = {1.0, -2.0, 0.5};
+    const double *columns[] = {xs.data(), ys.data()};
+    std::vector<double> out(3);
+    interpreter.evaluate(columns, 3, out.data());
+    for (int i = 0; i < 3; i++) {
+        CHECK_SAME(out[i], std::sin(xs[i]) * ys[i] + std::pow(xs[i], ys[i]) / 3.0);
+    }
+}
+
+// Under the Strict policy with the Libm math functions a compiled kernel
+// gives bit for bit the results of the interpreter, for single points and
+// for batches.
+static void test_parity() {
+    Func interpreted, compiled;
+    define(&interpreted);
+    define(&compiled);
+    interpreted.set_jit_threshold(std::numeric_limits<uint64_t>::max());
+    interpreted.realise();
+    compiled.set_vector_width(4);
+    compiled.realise();
+    CHECK(!interpreted.is_compiled());
+    CHECK(compiled.is_compiled());
+
+    auto points = arguments();
+    std::vector<std::vector<double>> columns(3);
+    for (auto &point : points) {
+        CHECK_SAME(interpreted(point.data()), compiled(point.data()));
+        for (int k = 0; k < 3; k++) {
+            columns[k].push_back(point[k]);
+        }
+    }
+    std::vector<const double*> pointers = {columns[0].data(), columns[1].data(), columns[2].data()};
+    std::vector<double> fromInterpreter(points.size()), fromKernel(points.size());
+    interpreted.evaluate(pointers, points.size(), fromInterpreter.data());
+    compiled.evaluate(pointers, points.size(), fromKernel.data());
+    bool same = true;
+    for (size_t i = 0; i < points.size(); i++) {
+        same = same && same_double(fromInterpreter[i], fromKernel[i]);
+    }
+    CHECK(same);
+}
+
+// After the threshold of points the kernel compiled in the background takes
+// over, and the results don't change.
+static void test_threshold() {
+    Func f;
+    define(&f);
+    f.set_jit_threshold(100);
+    f.realise();
+    CHECK(!f.is_compiled());
+    auto points = arguments();
+    std::vector<double> before;
+    for (auto &point : points) {
+        before.push_back(f(point.data()));
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!f.is_compiled() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(f.is_compiled());
+    CHECK(!f.background_compile_failed());
+    for (size_t i = 0; i < points.size(); i++) {
+        CHECK_SAME(f(points[i].data()), before[i]);
+    }
+}
+
+int main() {
+    test_interpreter();
+    test_parity();
+    test_threshold();
+    return check_result();
+}
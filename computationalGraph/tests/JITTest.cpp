@@ -0,0 +1,164 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Check.hpp"
+#include "Func.hpp"
+#include "Var.hpp"
+
+static double reference(double a, double b, double c) {
+    return std::sin(a * 10.01) + std::sin(b * std::pow(a, b)) / c;
+}
+
+static void define(Func *f) {
+    Var a, b, c;
+    (*f)(a, b, c) = F::sin(a * 10.01) + F::sin(b * F::pow(a, b)) / c;
+}
+
+// Columns of rows random arguments, positive so that pow is defined.
+static std::vector<std::vector<double>> random_columns(int64_t rows, unsigned seed) {
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> distribution(0.1, 3.0);
+    std::vector<std::vector<double>> columns(3, std::vector<double>(rows));
+    for (auto &column : columns) {
+        for (auto &value : column) {
+            value = distribution(random);
+        }
+    }
+    return columns;
+}
+
+static std::vector<const double*> pointers(const std::vector<std::vector<double>> &columns) {
+    std::vector<const double*> result;
+    for (auto &column : columns) {
+        result.push_back(column.data());
+    }
+    return result;
+}
+
+// Under the Strict policy every optimization level, vector width and entry
+// point computes exactly what the C++ expression does, including the scalar
+// remainder of rows which aren't a multiple of the width.
+static void test_levels_and_widths() {
+    auto columns = random_columns(37, 1);
+    for (unsigned level = 0; level <= 3; level++) {
+        for (unsigned width : {1u, 2u, 4u}) {
+            Func f;
+            define(&f);
+            f.set_optimization_level(level);
+            f.set_vector_width(width);
+            f.realise();
+            CHECK(f.is_compiled());
+
+            std::vector<double> out(37);
+            f.evaluate(pointers(columns), 37, out.data());
+            for (int64_t i = 0; i < 37; i++) {
+                double expected = reference(columns[0][i], columns[1][i], columns[2][i]);
+                CHECK_SAME(f(columns[0][i], columns[1][i], columns[2][i]), expected);
+                CHECK_SAME(out[i], expected);
+            }
+        }
+    }
+}
+
+// evaluate_parallel splits the rows over the ThreadPool and computes what
+// evaluate does.
+static void test_parallel() {
+    const int64_t rows = 100003;
+    auto columns = random_columns(rows, 2);
+    Func f;
+    define(&f);
+    f.realise();
+    std::vector<double> serial(rows), parallel(rows);
+    f.evaluate(pointers(columns), rows, serial.data());
+    f.evaluate_parallel(pointers(columns), rows, parallel.data());
+    bool same = true;
+    for (int64_t i = 0; i < rows; i++) {
+        same = same && same_double(serial[i], parallel[i]);
+    }
+    CHECK(same);
+}
+
+// Funcs compiled at the same time on several threads, each in a JITDylib of
+// its own with the same function names, don't see each other's code.
+static void test_concurrent_compiles() {
+    const int count = 16;
+    std::vector<std::unique_ptr<Func>> funcs;
+    std::vector<Func*> pointers;
+    Var x;
+    for (int i = 0; i < count; i++) {
+        funcs.emplace_back(new Func());
+        (*funcs.back())(x) = x * static_cast<double>(i) + 1.0;
+        pointers.push_back(funcs.back().get());
+    }
+    Func::realise_all(pointers, 4);
+    for (int i = 0; i < count; i++) {
+        CHECK(funcs[i]->is_compiled());
+        CHECK_SAME((*funcs[i])(2.0), 2.0 * i + 1.0);
+    }
+}
+
+// The quick kernel compiled in realise() is replaced by the optimized one
+// from a background thread, and both compute the same.
+static void test_background_optimization() {
+    Func f;
+    define(&f);
+    f.set_background_optimization(true);
+    f.realise();
+    CHECK(f.is_compiled());
+    for (int i = 0; i < 1000; i++) {
+        double a = 0.1 + i * 0.002;
+        CHECK_SAME(f(a, 1.5, 2.0), reference(a, 1.5, 2.0));
+    }
+    // realise() joins the background compile of the previous one.
+    f.realise();
+    CHECK(!f.background_compile_failed());
+    CHECK_SAME(f(0.5, 1.5, 2.0), reference(0.5, 1.5, 2.0));
+}
+
+// A Func can be defined and realised again, replacing its kernel.
+static void test_redefine() {
+    Func f;
+    Var x, y;
+    f(x, y) = x + y;
+    f.realise();
+    CHECK_SAME(f(1.0, 2.0), 3.0);
+    f(x, y) = x * y;
+    f.realise();
+    CHECK_SAME(f(3.0, 2.0), 6.0);
+    // The wrong number of arguments throws.
+    CHECK_THROWS(f(1.0));
+}
+
+int main() {
+    test_levels_and_widths();
+    test_parallel();
+    test_concurrent_compiles();
+    test_background_optimization();
+    test_redefine();
+    return check_result();
+}
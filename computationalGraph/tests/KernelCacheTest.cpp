@@ -0,0 +1,212 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "DiskObjectCache.hpp"
+#include "Func.hpp"
+#include "Graph.hpp"
+#include "KernelCache.hpp"
+#include "Var.hpp"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+static bool cache_hit(const Func &f) {
+    CompileTimings timings = f.compile_timings();
+    return timings.irgen == 0 && timings.optimize == 0 && timings.codegen == 0;
+}
+
+// The key doesn't depend on variable names or on the order of the operands
+// of + and *, but does on the structure, the constants and the options.
+static void test_keys() {
+    Var a, b, x, y;
+    std::string key = KernelCache::key(Graph({a, b}, {a * 2.0 + F::sin(b)}), "O2");
+    CHECK(KernelCache::key(Graph({x, y}, {F::sin(y) + 2.0 * x}), "O2") == key);
+    CHECK(KernelCache::key(Graph({a, b}, {a * 2.0 + F::sin(b)}), "O3") != key);
+    CHECK(KernelCache::key(Graph({a, b}, {a * 3.0 + F::sin(b)}), "O2") != key);
+    CHECK(KernelCache::key(Graph({a, b}, {b * 2.0 + F::sin(a)}), "O2") != key);
+    CHECK(KernelCache::key(Graph({a, b}, {a / 2.0 + F::sin(b)}), "O2") != key);
+}
+
+// A Func with a structurally equal expression and the same options reuses
+// the kernel of another without compiling, and other options don't.
+static void test_memory_cache() {
+    KernelCache::shared().clear();
+    Var a, b, x, y;
+    Func f, g, h;
+    f(a, b) = F::pow(a, b) + a;
+    g(x, y) = x + F::pow(x, y);
+    h(x, y) = x + F::pow(x, y);
+    h.set_optimization_level(1);
+
+    f.realise();
+    CHECK(!cache_hit(f));
+    g.realise();
+    CHECK(cache_hit(g));
+    h.realise();
+    CHECK(!cache_hit(h));
+    CHECK_SAME(g(2.0, 3.0), 10.0);
+    CHECK_SAME(h(2.0, 3.0), 10.0);
+
+    // After clear() the next realise() compiles again.
+    KernelCache::shared().clear();
+    g.realise();
+    CHECK(!cache_hit(g));
+    CHECK_SAME(g(2.0, 0.5), std::pow(2.0, 0.5) + 2.0);
+}
+
+// The .jitobj files of directory.
+static std::vector<std::string> objects(const std::string &directory) {
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (llvm::sys::fs::directory_iterator it(directory, error), end; it != end && !error; it.increment(error)) {
+        if (llvm::StringRef(it->path()).endswith(".jitobj")) {
+            paths.push_back(it->path());
+        }
+    }
+    return paths;
+}
+
+static uint64_t file_size(const std::string &path) {
+    uint64_t size = 0;
+    llvm::sys::fs::file_size(path, size);
+    return size;
+}
+
+static void write_file(const std::string &path, const std::string &content) {
+    std::error_code error;
+    llvm::raw_fd_ostream stream(path, error);
+    stream << content;
+}
+
+// Objects are stored and found by module identifier, and files which don't
+// hold what their header says are deleted instead of loaded.
+static void test_disk_object_cache(const std::string &directory) {
+    llvm::LLVMContext context;
+    llvm::Module first("first", context);
+    llvm::Module second("second", context);
+    DiskObjectCache cache(directory, 1 << 30);
+
+    CHECK(cache.lookup(&first, nullptr) == nullptr);
+    cache.notifyObjectCompiled(&first, llvm::MemoryBufferRef("first object", "first"));
+    auto object = cache.lookup(&first, nullptr);
+    CHECK(object != nullptr && object->getBuffer() == "first object");
+    CHECK(cache.lookup(&second, nullptr) == nullptr);
+    CHECK(objects(directory).size() == 1);
+
+    // A file cut short is discarded, and says so.
+    std::string path = objects(directory).front();
+    std::string content;
+    {
+        auto file = llvm::MemoryBuffer::getFile(path);
+        CHECK(bool(file));
+        content = (*file)->getBuffer().str();
+    }
+    write_file(path, content.substr(0, content.size() - 3));
+    std::string discarded;
+    CHECK(cache.lookup(&first, &discarded) == nullptr);
+    CHECK(!discarded.empty());
+    CHECK(objects(directory).empty());
+
+    // So is one whose object was changed.
+    cache.notifyObjectCompiled(&first, llvm::MemoryBufferRef("first object", "first"));
+    write_file(path, content.substr(0, content.size() - 1) + "T");
+    CHECK(cache.getObject(&first) == nullptr);
+    CHECK(objects(directory).empty());
+}
+
+// The directory is kept within maxBytes by removing the oldest objects.
+static void test_disk_eviction(const std::string &directory) {
+    llvm::LLVMContext context;
+    DiskObjectCache probe(directory, 1 << 30);
+    llvm::Module sizing("sizing", context);
+    probe.notifyObjectCompiled(&sizing, llvm::MemoryBufferRef("object", "sizing"));
+    uint64_t size = file_size(objects(directory).front());
+    llvm::sys::fs::remove(objects(directory).front());
+
+    DiskObjectCache cache(directory, size * 2 + size / 2);
+    for (const char *name : {"a", "b", "c", "d"}) {
+        llvm::Module module(std::string(name) + "-module", context);
+        cache.notifyObjectCompiled(&module, llvm::MemoryBufferRef("object", name));
+    }
+    uint64_t total = 0;
+    for (auto &path : objects(directory)) {
+        total += file_size(path);
+    }
+    CHECK(objects(directory).size() == 2);
+    CHECK(total <= size * 2 + size / 2);
+    for (auto &path : objects(directory)) {
+        llvm::sys::fs::remove(path);
+    }
+}
+
+// With a disk cache, a kernel dropped from memory is linked from the object
+// stored by the first compile, and a damaged object is compiled again.
+static void test_disk_kernels(const std::string &directory) {
+    KernelCache::shared().clear();
+    KernelCache::shared().set_disk_cache(directory, 1 << 30);
+    Var a, b;
+    Func f;
+    f(a, b) = F::sin(a) * b + 1.0;
+    f.realise();
+    CHECK(objects(directory).size() == 1);
+    double expected = std::sin(0.5) * 3.0 + 1.0;
+    CHECK_SAME(f(0.5, 3.0), expected);
+
+    KernelCache::shared().clear();
+    Func g;
+    g(a, b) = F::sin(a) * b + 1.0;
+    g.realise();
+    CHECK(objects(directory).size() == 1);
+    CHECK_SAME(g(0.5, 3.0), expected);
+
+    KernelCache::shared().clear();
+    write_file(objects(directory).front(), "garbage");
+    Func h;
+    h(a, b) = F::sin(a) * b + 1.0;
+    h.realise();
+    CHECK_SAME(h(0.5, 3.0), expected);
+    CHECK(objects(directory).size() == 1);
+    CHECK(file_size(objects(directory).front()) > 7);
+}
+
+int main() {
+    test_keys();
+    test_memory_cache();
+
+    llvm::SmallString<256> directory;
+    if (llvm::sys::fs::createUniqueDirectory("kernel-cache-test", directory)) {
+        return 1;
+    }
+    test_disk_object_cache(directory.str().str());
+    test_disk_eviction(directory.str().str());
+    test_disk_kernels(directory.str().str());
+    llvm::sys::fs::remove_directories(directory);
+    return check_result();
+}
@@ -0,0 +1,382 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "JIT.hpp"
+#include "MathLibrary.hpp"
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/TargetSelect.h"
+
+// out[i] = name(x[i], y[i]) for rows a multiple of the width, y being
+// ignored by the functions of one argument.
+typedef void (*Kernel)(const double *x, const double *y, double *out, int64_t rows);
+
+static const char *names[] = {"sin", "cos", "exp", "log", "pow"};
+static const unsigned bounds[] = {1, 8, 1000, 4096};
+static const unsigned widths[] = {1, 2, 4};
+
+// The rows of the inputs are padded to a multiple of this.
+static const size_t block = 4;
+
+// The error of the long double references in ulps of a double, which is 1
+// where long double is double.
+static const double referenceError = std::numeric_limits<long double>::digits > 53 ? 0.0 : 1.0;
+
+static std::string kernel_name(const std::string &name, unsigned bound, unsigned width) {
+    return name + "_u" + std::to_string(bound) + "_v" + std::to_string(width);
+}
+
+// Emit the loop calling the MathLibrary function name on width rows at once.
+static void emit_kernel(llvm::Module *module, MathLibrary *library, const std::string &name,
+                        unsigned bound, unsigned width) {
+    using llvm::Type;
+    llvm::LLVMContext &context = module->getContext();
+    llvm::IRBuilder<> builder(context);
+
+    Type *doubleType = Type::getDoubleTy(context);
+    Type *doublePtrType = llvm::PointerType::getUnqual(doubleType);
+    Type *int64Type = Type::getInt64Ty(context);
+    Type *type = doubleType;
+    if (width > 1) {
+        type = llvm::VectorType::get(doubleType, width);
+    }
+    Type *ptrType = llvm::PointerType::getUnqual(type);
+    llvm::Function *callee = library->function(name, type, width);
+
+    std::vector<Type *> parameters = {doublePtrType, doublePtrType, doublePtrType, int64Type};
+    llvm::FunctionType *functionType = llvm::FunctionType::get(Type::getVoidTy(context), parameters, false);
+    llvm::Function *kernel = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage,
+                                                    kernel_name(name, bound, width), module);
+    auto it = kernel->arg_begin();
+    llvm::Value *x = &*it++;
+    llvm::Value *y = &*it++;
+    llvm::Value *out = &*it++;
+    llvm::Value *rows = &*it++;
+
+    llvm::BasicBlock *entryBlock = llvm::BasicBlock::Create(context, "entry", kernel);
+    llvm::BasicBlock *loopBlock = llvm::BasicBlock::Create(context, "loop", kernel);
+    llvm::BasicBlock *exitBlock = llvm::BasicBlock::Create(context, "exit", kernel);
+    builder.SetInsertPoint(entryBlock);
+    builder.CreateCondBr(builder.CreateICmpSGT(rows, builder.getInt64(0)), loopBlock, exitBlock);
+
+    builder.SetInsertPoint(loopBlock);
+    llvm::PHINode *index = builder.CreatePHI(int64Type, 2, "i");
+    index->addIncoming(builder.getInt64(0), entryBlock);
+    std::vector<llvm::Value *> arguments;
+    for (llvm::Value *column : {x, y}) {
+        if (arguments.size() == callee->arg_size()) {
+            break;
+        }
+        llvm::Value *address = builder.CreateInBoundsGEP(doubleType, column, index, "argptr");
+        address = builder.CreateBitCast(address, ptrType);
+        arguments.push_back(builder.CreateAlignedLoad(type, address, sizeof(double), "argument"));
+    }
+    llvm::Value *result = builder.CreateCall(callee, arguments);
+    llvm::Value *outAddress = builder.CreateInBoundsGEP(doubleType, out, index, "outptr");
+    outAddress = builder.CreateBitCast(outAddress, ptrType);
+    builder.CreateAlignedStore(result, outAddress, sizeof(double));
+    llvm::Value *next = builder.CreateAdd(index, builder.getInt64(width), "next");
+    index->addIncoming(next, loopBlock);
+    builder.CreateCondBr(builder.CreateICmpSLT(next, rows), loopBlock, exitBlock);
+
+    builder.SetInsertPoint(exitBlock);
+    builder.CreateRetVoid();
+}
+
+// Every function at every bound and width, linked by the JIT.
+static std::map<std::string, Kernel> compile_kernels() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto context = llvm::make_unique<llvm::LLVMContext>();
+    auto module = llvm::make_unique<llvm::Module>("mathlibrary", *context);
+    for (unsigned bound : bounds) {
+        MathLibrary library(module.get(), bound);
+        for (unsigned width : widths) {
+            for (auto name : names) {
+                emit_kernel(module.get(), &library, name, bound, width);
+            }
+        }
+    }
+    CHECK(!llvm::verifyModule(*module, &llvm::errs()));
+
+    JITModule linked = JIT::shared().add(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)), 2);
+    std::map<std::string, Kernel> kernels;
+    for (unsigned bound : bounds) {
+        for (unsigned width : widths) {
+            for (auto name : names) {
+                std::string kernel = kernel_name(name, bound, width);
+                kernels[kernel] = reinterpret_cast<Kernel>(linked.address(kernel));
+            }
+        }
+    }
+    return kernels;
+}
+
+static long double reference(const std::string &name, double x, double y) {
+    if (name == "sin") {
+        return sinl(x);
+    } else if (name == "cos") {
+        return cosl(x);
+    } else if (name == "exp") {
+        return expl(x);
+    } else if (name == "log") {
+        return logl(x);
+    }
+    return powl(x, y);
+}
+
+static double libm(const std::string &name, double x, double y) {
+    if (name == "sin") {
+        return std::sin(x);
+    } else if (name == "cos") {
+        return std::cos(x);
+    } else if (name == "exp") {
+        return std::exp(x);
+    } else if (name == "log") {
+        return std::log(x);
+    }
+    return std::pow(x, y);
+}
+
+// The distance of result from expected in ulps of the double nearest
+// expected. Non-finite results have to be the expected ones exactly.
+static double ulp_error(double result, long double expected) {
+    double nearest = static_cast<double>(expected);
+    if (std::isnan(nearest) || std::isnan(result)) {
+        return std::isnan(nearest) && std::isnan(result) ? 0.0 : INFINITY;
+    }
+    if (std::isinf(nearest) || std::isinf(result)) {
+        return result == nearest ? 0.0 : INFINITY;
+    }
+    int exponent = -1021;
+    if (nearest != 0.0) {
+        std::frexp(nearest, &exponent);
+    }
+    double ulp = std::ldexp(1.0, std::max(exponent - 53, -1074));
+    return static_cast<double>(std::fabs(static_cast<long double>(result) - expected) / ulp);
+}
+
+// The error of result in the measure the bound of the MathLibrary applies
+// to: ulps, except for the fast sin and cos, which are within bound ulps
+// of 1 close to their zeros.
+static double error(const std::string &name, unsigned bound, double result, long double expected) {
+    double ulps = ulp_error(result, expected);
+    if ((name == "sin" || name == "cos") && bound >= 4 && std::isfinite(result)) {
+        double absolute = static_cast<double>(std::fabs(static_cast<long double>(result) - expected));
+        ulps = std::fmin(ulps, absolute / std::ldexp(1.0, -53));
+    }
+    return ulps;
+}
+
+// Whether libm computes name at x and y, rather than the vector code. Only
+// the arguments clearly outside the range of the vector code count.
+static bool fallback(const std::string &name, unsigned bound, double x, double y) {
+    if (name == "sin" || name == "cos") {
+        return !(std::fabs(x) <= 1048576.0);
+    } else if (name == "exp") {
+        return !(std::fabs(x) <= 708.0);
+    }
+    bool positiveNormal = x >= std::numeric_limits<double>::min() && x < INFINITY;
+    if (name == "log" || !positiveNormal) {
+        return !positiveNormal;
+    }
+    if (bound >= 4096) {
+        return !(std::fabs(y * std::log(x)) <= 710.0);
+    }
+    return !(std::fabs(y) < 2147483648.0) || !(std::fabs(y * std::log2(x)) <= 1021.0);
+}
+
+struct Inputs {
+    std::vector<double> x;
+    std::vector<double> y;
+
+    void add(double a, double b) {
+        x.push_back(a);
+        y.push_back(b);
+    }
+};
+
+// Random arguments over the ranges each function is used on, including
+// where the argument reduction loses the most.
+static Inputs random_inputs(const std::string &name, std::mt19937_64 &random) {
+    auto uniform = [&](double low, double high) {
+        return std::uniform_real_distribution<double>(low, high)(random);
+    };
+    auto tiny = [&]() { return std::ldexp(uniform(-1.0, 1.0), -static_cast<int>(random() % 60)); };
+    Inputs inputs;
+    for (int i = 0; i < 40000; i++) {
+        int kind = i % 4;
+        if (name == "sin" || name == "cos") {
+            double x = kind == 0 ? uniform(-10.0, 10.0)
+                     : kind == 1 ? uniform(-1048576.0, 1048576.0)
+                     : kind == 2 ? std::nearbyint(uniform(-600000.0, 600000.0)) * M_PI_2
+                     : tiny();
+            inputs.add(x, 0.0);
+        } else if (name == "exp") {
+            double x = kind == 0 ? uniform(-708.0, 708.0) : kind == 1 ? uniform(-1.0, 1.0) : tiny();
+            inputs.add(x, 0.0);
+        } else if (name == "log") {
+            uint64_t bits = (random() & 0x000fffffffffffffULL) | ((1 + random() % 2046) << 52);
+            double x;
+            std::memcpy(&x, &bits, sizeof x);
+            if (kind == 1) {
+                x = 1.0 + tiny();
+            } else if (kind == 2) {
+                x = uniform(0.5, 2.0);
+            }
+            inputs.add(x, 0.0);
+        } else if (kind == 0) {
+            inputs.add(std::exp(uniform(-7.0, 7.0)), uniform(-50.0, 50.0));
+        } else if (kind == 1) {
+            inputs.add(1.0 + std::ldexp(uniform(-1.0, 1.0), -static_cast<int>(random() % 30)), uniform(-1e6, 1e6));
+        } else if (kind == 2) {
+            inputs.add(uniform(0.0, 10.0), std::nearbyint(uniform(-30.0, 30.0)));
+        } else {
+            // Negative x with integral y, for which pow is defined.
+            inputs.add(-uniform(0.1, 20.0), std::nearbyint(uniform(-30.0, 30.0)));
+        }
+    }
+    return inputs;
+}
+
+// The arguments at and beyond the edges of the vector code, each in every
+// lane of a block whose other lanes hold ordinary arguments.
+static Inputs edge_inputs(const std::string &name) {
+    const double subnormal = 4.9406564584124654e-324;
+    std::vector<std::pair<double, double>> edges = {
+        {0.0, 2.0}, {-0.0, 3.0}, {subnormal, 0.5}, {-subnormal, 2.0}, {1e-310, -1.0}, {1.0, 1e300},
+        {NAN, 1.0}, {1.0, NAN}, {INFINITY, 2.0}, {-INFINITY, 3.0}, {2.0, INFINITY}, {0.5, -INFINITY},
+    };
+    if (name == "sin" || name == "cos") {
+        for (double x : {1048576.0, 1048577.0, 1572864.5, 3e6, 1e22, 1e300, 1.7976931348623157e308}) {
+            edges.push_back({x, 0.0});
+            edges.push_back({-x, 0.0});
+        }
+    } else if (name == "exp") {
+        for (double x : {707.99, 708.0, 708.1, 709.78, 709.79, 710.0, 745.2, 745.1, 800.0}) {
+            edges.push_back({x, 0.0});
+            edges.push_back({-x, 0.0});
+        }
+    } else if (name == "log") {
+        for (double x : {-1.0, -subnormal, 2.2250738585072014e-308, 2.2250738585072009e-308, 1.7976931348623157e308}) {
+            edges.push_back({x, 0.0});
+        }
+    } else {
+        edges.insert(edges.end(), {
+            {-2.0, 3.0}, {-2.0, -3.0}, {-2.0, 0.5}, {-0.5, 1e10}, {-1.0, INFINITY}, {0.0, -1.0}, {-0.0, -3.0},
+            {2.0, 1023.0}, {2.0, 1024.0}, {2.0, -1074.0}, {2.0, -1075.0}, {10.0, 308.5}, {10.0, -320.0},
+            {1.0000001, 3e9}, {2.0, 2147483648.0}, {1e-310, 0.5}, {1e300, 1.1}, {0.0, 0.0}, {NAN, 0.0},
+        });
+    }
+
+    const double ordinaryX[block] = {0.75, 1.5, 2.25, 3.5};
+    const double ordinaryY[block] = {1.25, -0.5, 2.0, 3.0};
+    Inputs inputs;
+    for (auto &edge : edges) {
+        for (size_t lane = 0; lane < block; lane++) {
+            for (size_t i = 0; i < block; i++) {
+                if (i == lane) {
+                    inputs.add(edge.first, edge.second);
+                } else {
+                    inputs.add(ordinaryX[i], ordinaryY[i]);
+                }
+            }
+        }
+    }
+    return inputs;
+}
+
+// Check every width and bound of name on inputs against the references:
+// within the bound, with the lanes libm computes being libm's and every
+// width computing what the scalar function does, so that a lane doesn't
+// depend on the others.
+static void check_inputs(const std::map<std::string, Kernel> &kernels, const std::string &name,
+                         const Inputs &inputs, const char *what) {
+    size_t rows = inputs.x.size();
+    for (unsigned bound : bounds) {
+        double allowed = (bound < 4 ? 1.0 : bound) + referenceError;
+        std::vector<double> scalar(rows);
+        kernels.at(kernel_name(name, bound, 1))(inputs.x.data(), inputs.y.data(), scalar.data(), rows);
+
+        double worst = 0.0;
+        size_t worstRow = 0;
+        size_t notLibm = 0;
+        for (size_t i = 0; i < rows; i++) {
+            double e = error(name, bound, scalar[i], reference(name, inputs.x[i], inputs.y[i]));
+            if (!(e <= worst)) {
+                worst = e;
+                worstRow = i;
+            }
+            if (fallback(name, bound, inputs.x[i], inputs.y[i]) &&
+                !same_double(scalar[i], libm(name, inputs.x[i], inputs.y[i]))) {
+                notLibm++;
+            }
+        }
+        if (!CHECK(worst <= allowed)) {
+            std::cerr << "  " << what << " " << name << " bound " << bound << ": " << worst << " ulps at ("
+                      << inputs.x[worstRow] << ", " << inputs.y[worstRow] << ")" << std::endl;
+        }
+        if (!CHECK(notLibm == 0)) {
+            std::cerr << "  " << what << " " << name << " bound " << bound << ": " << notLibm
+                      << " fallback lanes differ from libm" << std::endl;
+        }
+
+        for (unsigned width : widths) {
+            std::vector<double> vector(rows);
+            kernels.at(kernel_name(name, bound, width))(inputs.x.data(), inputs.y.data(), vector.data(), rows);
+            size_t different = 0;
+            for (size_t i = 0; i < rows; i++) {
+                different += !same_double(vector[i], scalar[i]);
+            }
+            if (!CHECK(different == 0)) {
+                std::cerr << "  " << what << " " << name << " bound " << bound << " width " << width << ": "
+                          << different << " lanes differ from the scalar function" << std::endl;
+            }
+        }
+    }
+}
+
+int main() {
+    std::map<std::string, Kernel> kernels = compile_kernels();
+    std::mt19937_64 random(1);
+    for (auto name : names) {
+        check_inputs(kernels, name, random_inputs(name, random), "random");
+        check_inputs(kernels, name, edge_inputs(name), "edge");
+    }
+    return check_result();
+}
@@ -0,0 +1,173 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+#include "Func.hpp"
+#include "Graph.hpp"
+#include "Jacobian.hpp"
+#include "Param.hpp"
+#include "Var.hpp"
+
+// A changed Param is seen by the next call of every entry point, without
+// compiling again, including every row of a vector batch.
+static void test_set_param() {
+    Var x;
+    Param scale("scale", 2.0);
+    Func f;
+    f(x) = x * scale + Param("offset", 1.0);
+    f.set_vector_width(4);
+    f.realise();
+    CHECK_SAME(f(3.0), 7.0);
+
+    f.set_param("scale", 5.0);
+    CHECK_SAME(f(3.0), 16.0);
+    f.set_param("offset", -1.0);
+    CHECK_SAME(f(3.0), 14.0);
+
+    std::vector<double> xs(37), out(37);
+    for (size_t i = 0; i < xs.size(); i++) {
+        xs[i] = i * 0.5;
+    }
+    f.evaluate({xs.data()}, 37, out.data());
+    bool same = true;
+    for (size_t i = 0; i < xs.size(); i++) {
+        same = same && out[i] == xs[i] * 5.0 - 1.0;
+    }
+    CHECK(same);
+
+    CHECK_THROWS(f.set_param("missing", 1.0));
+
+    // Values set before realise() are kept by it, and by the next one.
+    Func g;
+    g(x) = x * scale;
+    g.set_param("scale", 4.0);
+    g.realise();
+    CHECK_SAME(g(2.0), 8.0);
+    g.realise();
+    CHECK_SAME(g(2.0), 8.0);
+}
+
+// Funcs with equal expressions don't share the values of their Params,
+// although equal expressions otherwise share a kernel.
+static void test_separate_values() {
+    Var x;
+    Param p("p", 1.0);
+    Func f, g;
+    f(x) = x + p;
+    g(x) = x + p;
+    f.realise();
+    g.realise();
+    f.set_param("p", 10.0);
+    CHECK_SAME(f(1.0), 11.0);
+    CHECK_SAME(g(1.0), 2.0);
+}
+
+// The interpreter, specializations and the gradient kernel read Params too.
+static void test_everywhere() {
+    Var x, y;
+    Param p("p", 3.0);
+
+    Func interpreted;
+    interpreted(x) = x * p;
+    interpreted.set_jit_threshold(std::numeric_limits<uint64_t>::max());
+    interpreted.realise();
+    interpreted.set_param("p", 4.0);
+    CHECK_SAME(interpreted(2.0), 8.0);
+
+    Func f;
+    f(x, y) = x * p + y;
+    f.realise_with_gradient();
+    Func &g = f.specialize({{y, 1.0}});
+    f.set_param("p", 6.0);
+    CHECK_SAME(f(2.0, 1.0), 13.0);
+    CHECK_SAME(g(2.0), 13.0);
+    std::vector<double> gradient = f.gradient({2.0, 1.0});
+    CHECK_SAME(gradient[0], 13.0);
+    CHECK_SAME(gradient[1], 6.0);
+    CHECK_SAME(gradient[2], 1.0);
+
+    Jacobian jacobian;
+    jacobian(x, y) = {x * p, y + p};
+    jacobian.realise();
+    jacobian.set_param("p", 2.0);
+    double values[2];
+    double entries[2];
+    jacobian({5.0, 1.0}, values, entries);
+    CHECK_SAME(values[0], 10.0);
+    CHECK_SAME(values[1], 3.0);
+    CHECK_SAME(entries[0], 2.0);
+    CHECK_THROWS(jacobian.set_param("missing", 1.0));
+}
+
+// A call running while set_param runs sees either value.
+static void test_concurrent_set_param() {
+    Var x;
+    Func f;
+    f(x) = x * Param("q", 1.0);
+    f.realise();
+    std::atomic<bool> done(false);
+    std::atomic<bool> valid(true);
+    std::thread caller([&]() {
+        while (!done) {
+            double result = f(3.0);
+            if (result != 3.0 && result != 6.0) {
+                valid = false;
+            }
+        }
+    });
+    for (int i = 0; i < 10000; i++) {
+        f.set_param("q", i % 2 == 0 ? 2.0 : 1.0);
+    }
+    done = true;
+    caller.join();
+    CHECK(valid);
+}
+
+// Params are told apart by name, so two of one name must agree on their
+// start value.
+static void test_conflicting_names() {
+    Graph graph(1);
+    int first = graph.parameter("p", 1.0);
+    CHECK(graph.parameter("p", 1.0) == first);
+    CHECK(graph.parameter("q", 2.0) != first);
+    CHECK_THROWS(graph.parameter("p", 2.0));
+
+    Var x;
+    Func f;
+    f(x) = x * Param("r", 1.0) + Param("r", 2.0);
+    CHECK_THROWS(f.realise());
+}
+
+int main() {
+    test_set_param();
+    test_separate_values();
+    test_everywhere();
+    test_concurrent_set_param();
+    test_conflicting_names();
+    return check_result();
+}
@@ -0,0 +1,134 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Check.hpp"
+#include "Func.hpp"
+#include "Graph.hpp"
+#include "Interpreter.hpp"
+#include "Reassociator.hpp"
+#include "Var.hpp"
+
+// The longest path of + and * operations from an input to an output.
+static int depth(const Graph &graph) {
+    std::vector<int> depths(graph.size(), 0);
+    int deepest = 0;
+    for (size_t i = 0; i < graph.size(); i++) {
+        const Graph::Node &node = graph[i];
+        int operands = Graph::arity(node.opcode);
+        int below = 0;
+        if (operands > 0) {
+            below = std::max(below, depths[node.a]);
+        }
+        if (operands > 1) {
+            below = std::max(below, depths[node.b]);
+        }
+        depths[i] = below + (Graph::is_commutative(node.opcode) ? 1 : 0);
+        deepest = std::max(deepest, depths[i]);
+    }
+    return deepest;
+}
+
+// The left-deep sum of sin(x * k) for k in 1..n, as operator+ builds it.
+static Expr sum(const Var &x, int n) {
+    Expr result = F::sin(x * 1.0);
+    for (int k = 2; k <= n; k++) {
+        result = result + F::sin(x * static_cast<double>(k));
+    }
+    return result;
+}
+
+// Every strategy shortens a chain of 64 terms to about the depth it
+// promises, and computes the same sum up to rounding.
+static void test_strategies() {
+    Var x;
+    Graph graph({x}, {sum(x, 64)});
+    CHECK(depth(graph) >= 64);
+    double point[] = {0.3};
+    double plain = Interpreter(graph).evaluate(point);
+
+    Graph pairwise = Reassociator(Reassociator::Pairwise).run(graph);
+    Graph balanced = Reassociator(Reassociator::Balanced).run(graph);
+    Graph accumulators = Reassociator(Reassociator::Accumulators, 4).run(graph);
+    CHECK(depth(pairwise) <= 7);
+    CHECK(depth(balanced) <= 7);
+    CHECK(depth(accumulators) <= 16 + 3);
+    for (const Graph *rebuilt : {&pairwise, &balanced, &accumulators}) {
+        CHECK_CLOSE(Interpreter(*rebuilt).evaluate(point), plain, 1e-13);
+    }
+
+    // None leaves the graph as it is.
+    CHECK(depth(Reassociator(Reassociator::None).run(graph)) == depth(graph));
+    CHECK_THROWS(Reassociator(Reassociator::Accumulators, 0));
+}
+
+// A partial sum which is used twice isn't taken apart, and products are
+// rebuilt like sums.
+static void test_shared_and_products() {
+    Var x, y;
+    Expr partial = x + y * 2.0 + x * y;
+    Expr product = x * y * (x + 1.0) * (y + 2.0) * (x + 3.0) * (y + 4.0);
+    Graph graph({x, y}, {partial * (partial + x + y + 5.0) + product});
+    Graph rebuilt = Reassociator(Reassociator::Pairwise).run(graph);
+    CHECK(depth(rebuilt) <= depth(graph));
+    double points[][2] = {{0.5, 1.5}, {-2.0, 3.0}, {10.0, -0.25}};
+    for (auto &point : points) {
+        CHECK_CLOSE(Interpreter(rebuilt).evaluate(point), Interpreter(graph).evaluate(point), 1e-13);
+    }
+}
+
+// A Func with reassociation computes what one without does; the sum of
+// small integers is exact either way.
+static void test_func() {
+    Var x;
+    Func plain, pairwise, accumulators;
+    plain(x) = sum(x, 40);
+    pairwise(x) = sum(x, 40);
+    accumulators(x) = sum(x, 40);
+    pairwise.set_reassociation(Reassociator::Pairwise);
+    accumulators.set_reassociation(Reassociator::Accumulators, 8);
+    plain.realise();
+    pairwise.realise();
+    accumulators.realise();
+    for (double value = -2.0; value < 2.0; value += 0.1) {
+        CHECK_CLOSE(pairwise(value), plain(value), 1e-13);
+        CHECK_CLOSE(accumulators(value), plain(value), 1e-13);
+    }
+
+    Var a, b, c, d, e;
+    Func integers;
+    integers(a, b, c, d, e) = a + b + c + d + e + a * b + c * d + 7.0;
+    integers.set_reassociation(Reassociator::Balanced);
+    integers.realise();
+    CHECK_SAME(integers(1.0, 2.0, 3.0, 4.0, 5.0), 1.0 + 2.0 + 3.0 + 4.0 + 5.0 + 2.0 + 12.0 + 7.0);
+}
+
+int main() {
+    test_strategies();
+    test_shared_and_products();
+    test_func();
+    return check_result();
+}
@@ -0,0 +1,131 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+#include "Func.hpp"
+#include "Var.hpp"
+
+// Binding arguments gives a Func of the others which computes what the
+// general one does with the bound values.
+static void test_specialize() {
+    Var a, b, c;
+    Func f;
+    f(a, b, c) = F::sin(a * b) + F::pow(b, c) / a + b * c;
+    f.realise();
+
+    Func &g = f.specialize({{b, 2.0}});
+    CHECK(&f.specialize({{b, 2.0}}) == &g);
+    Func &h = f.specialize({{b, 0.5}, {c, 3.0}});
+    CHECK(&h != &g);
+    for (double x = -3.0; x < 3.0; x += 0.37) {
+        for (double z = -2.0; z < 2.0; z += 0.41) {
+            CHECK_SAME(g(x, z), f(x, 2.0, z));
+        }
+        CHECK_SAME(h(x), f(x, 0.5, 3.0));
+    }
+
+    // -0 is told apart from 0.
+    Func &zero = f.specialize({{b, 0.0}});
+    Func &negativeZero = f.specialize({{b, -0.0}});
+    CHECK(&zero != &negativeZero);
+    CHECK_SAME(negativeZero(1.0, -1.0), f(1.0, -0.0, -1.0));
+    CHECK_SAME(zero(1.0, -1.0), f(1.0, 0.0, -1.0));
+
+    // Only arguments of the Func can be bound.
+    Var other;
+    CHECK_THROWS(f.specialize({{other, 1.0}}));
+}
+
+// With value profiling, calls switch to a caller guarded by the values the
+// profile saw, while still computing the same for every argument, sampled
+// from several threads at once.
+static void test_value_profiling() {
+    Var a, b, c;
+    Func general, profiled;
+    general(a, b, c) = F::pow(a, b) * c + F::sin(b * c);
+    profiled(a, b, c) = F::pow(a, b) * c + F::sin(b * c);
+    general.realise();
+    profiled.set_value_profiling(64);
+    profiled.realise();
+
+    // b is invariant and c takes two values, in the profile and after it.
+    std::atomic<bool> same(true);
+    auto call = [&](unsigned seed, std::chrono::milliseconds duration) {
+        std::mt19937_64 random(seed);
+        std::uniform_real_distribution<double> distribution(0.1, 4.0);
+        auto end = std::chrono::steady_clock::now() + duration;
+        int i = 0;
+        do {
+            double point[] = {distribution(random), 1.5, i % 2 == 0 ? 2.0 : -1.0};
+            if (!same_double(profiled(point), general(point))) {
+                same = false;
+            }
+            i++;
+        } while (std::chrono::steady_clock::now() < end || i < 64);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 4; t++) {
+        threads.emplace_back(call, t, std::chrono::milliseconds(300));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    CHECK(same);
+    CHECK(!profiled.value_profiling_failed());
+
+    // Values the guards don't match take the general callee.
+    const double others[][3] = {{2.0, 3.0, 2.0}, {2.0, 1.5, 5.0}, {0.5, -1.5, -1.0}, {2.0, 1.5, -0.0}};
+    for (auto &point : others) {
+        CHECK_SAME(profiled(point), general(point));
+    }
+}
+
+// Profiling a Func whose arguments all vary specializes nothing, and leaves
+// the results alone.
+static void test_nothing_to_specialize() {
+    Var a, b;
+    Func f;
+    f(a, b) = a * b + 1.0;
+    f.set_value_profiling(16);
+    f.realise();
+    for (int i = 0; i < 100; i++) {
+        CHECK_SAME(f(i * 1.0, i * 0.5), i * (i * 0.5) + 1.0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(!f.value_profiling_failed());
+    CHECK_SAME(f(3.0, 4.0), 13.0);
+}
+
+int main() {
+    test_specialize();
+    test_value_profiling();
+    test_nothing_to_specialize();
+    return check_result();
+}
@@ -0,0 +1,115 @@
+// MIT License
+//
+// Copyright (c) 2020 sonson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT W  ARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "Check.hpp"
+#include "Func.hpp"
+#include "Param.hpp"
+#include "ThreadPool.hpp"
+#include "Var.hpp"
+
+// Every index of the range is visited exactly once, in chunks of at most
+// grain elements starting at multiples of grain.
+static void test_coverage(ThreadPool &pool) {
+    const int64_t counts[] = {0, 1, 7, 64, 1000, 4097};
+    const int64_t grains[] = {1, 3, 64, 5000};
+    for (int64_t count : counts) {
+        for (int64_t grain : grains) {
+            std::vector<std::atomic<int>> visits(count);
+            for (auto &visit : visits) {
+                visit = 0;
+            }
+            std::atomic<bool> aligned(true);
+            pool.parallel_for(count, grain, [&](int64_t begin, int64_t end) {
+                if (begin % grain != 0 || end - begin > grain || end <= begin) {
+                    aligned = false;
+                }
+                for (int64_t i = begin; i < end; i++) {
+                    visits[i]++;
+                }
+            });
+            bool once = true;
+            for (auto &visit : visits) {
+                once = once && visit == 1;
+            }
+            CHECK(once);
+            CHECK(aligned);
+        }
+    }
+}
+
+// A throwing chunk doesn't leave parallel_for waiting, its exception reaches
+// the caller, and the pool keeps working afterwards.
+static void test_exceptions(ThreadPool &pool) {
+    for (int repeat = 0; repeat < 100; repeat++) {
+        bool caught = false;
+        try {
+            pool.parallel_for(1000, 10, [](int64_t begin, int64_t /*end*/) {
+                if (begin == 500) {
+                    throw std::runtime_error("chunk");
+                }
+            });
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+        CHECK(caught);
+    }
+
+    // Every chunk throwing still rethrows only one exception.
+    CHECK_THROWS(pool.parallel_for(100, 1, [](int64_t, int64_t) { throw 1; }));
+
+    // A single chunk runs on the calling thread, and throws from there.
+    CHECK_THROWS(pool.parallel_for(5, 10, [](int64_t, int64_t) { throw 1; }));
+
+    std::atomic<int64_t> sum(0);
+    pool.parallel_for(1000, 10, [&](int64_t begin, int64_t end) {
+        sum += end - begin;
+    });
+    CHECK(sum == 1000);
+}
+
+// realise_all realises the Funcs which can be realised and rethrows the
+// failure of the one which can't.
+static void test_realise_all() {
+    Var x;
+    Func good1, bad, good2;
+    good1(x) = x * 2.0;
+    // Two Params of one name with different start values can't be lowered.
+    bad(x) = x * Param("p", 1.0) + Param("p", 2.0);
+    good2(x) = F::sin(x);
+    CHECK_THROWS(Func::realise_all({&good1, &bad, &good2}, 3));
+    CHECK(good1.is_compiled());
+    CHECK(good2.is_compiled());
+    CHECK_SAME(good1(1.5), 3.0);
+}
+
+int main() {
+    ThreadPool pool(3);
+    test_coverage(pool);
+    test_exceptions(pool);
+    test_realise_all();
+    return check_result();
+}